@@ -1,14 +1,50 @@
 #ifndef CONSTANTS_H
 #define CONSTANTS_H
 
-#define LOCALHOST "127.0.0.1"
+#define DEFAULT_PEER_HOST "127.0.0.1" // When a peer address has no host
 #define DEFAULT_PORT 21000
 #define WAIT_TIME 5000 // ms
+#define RECONNECT_MIN_DELAY 1000 // ms
+#define RECONNECT_MAX_DELAY 60000 // ms
+#define PEER_STABLE_TIME 30000 // ms, shorter connections count as failures
 #define DEFAULT_DIFF 21
 #define BLOCK_GENERATION_INTERVAL 10000 // ms
-#define DIFF_ADJUST_INTERVAL 10 // blocks
+#define DIFF_ADJUST_INTERVAL 10 // blocks, for the step retarget policy
+#define DIFF_RETARGET_WINDOW 30 // blocks averaged by the proportional retarget policy
+#define DIFF_MAX_STEP 64 // 1/256 bits the proportional policy may move per block
 #define MAX_CHAIN_LENGTH 2000
 #define TIMESTAMP_LENGTH 60000
-#define LEDGER_UPDATE_TIME 200
+#define KEEPALIVE_INTERVAL 30000 // ms between tip announcements on an idle chain
+#define ANNOUNCE_MIN_INTERVAL 20 // ms, tip changes closer than this are announced together
+#define DEFAULT_MINER_THREADS 0 // 0 = one per core
+#define HASH_COUNT_INTERVAL 65536 // hashes a miner thread computes between hash count updates
+#define VERIFIED_CACHE_SIZE 10000 // blocks
+#define MAX_BLOCKS_PER_MESSAGE 500
+#define BLOCK_REQUEST_TIMEOUT 10000 // ms, unanswered block requests are sent again on the next tip
+#define MAX_FRAME_SIZE (64 * 1024 * 1024) // bytes
+#define STORE_SYNC_INTERVAL 16 // blocks
+#define MAX_ORPHAN_BLOCKS 2000 // blocks
+#define BLOCK_PRUNE_DEPTH 100 // blocks below the tip whose payloads the block tree leaves to the ledger
+#define STALE_BRANCH_AGE 2000 // blocks inserted since a side branch last grew before it is dropped
+#define MIN_VALIDATION_CHUNK 64 // blocks per hashing task
+#define PEER_INITIAL_SCORE 100
+#define PEER_MAX_SCORE 200
+#define PEER_VALID_BLOCKS_REWARD 5
+#define PEER_MALFORMED_PENALTY 20
+#define PEER_INVALID_BLOCKS_PENALTY 50
+#define PEER_WRITE_HIGH_WATERMARK (4 * 1024 * 1024) // bytes, above it the peer lags
+#define PEER_WRITE_LOW_WATERMARK (1024 * 1024) // bytes, below it the peer caught up
+#define PEER_WRITE_BUDGET (2 * MAX_FRAME_SIZE) // bytes, above it the peer is disconnected
+#define PEER_LAG_TIMEOUT 30000 // ms a peer may lag before it is disconnected
+#define METRICS_MAX_REQUEST 8192 // bytes of an HTTP request line
+#define LEDGER_VIEW_ROWS 1000 // blocks shown in the GUI
+#define LEDGER_VIEW_FRAME_INTERVAL 50 // ms between GUI ledger updates
+#define MESSAGE_LOG_ROWS 1000 // messages kept in the GUI
+#define MAX_TRANSACTION_SIZE (64 * 1024) // bytes of transaction data
+#define MEMPOOL_MAX_BYTES (64 * 1024 * 1024)
+#define MEMPOOL_CONFIRMED_CACHE 100000 // transactions
+#define BLOCK_MAX_PAYLOAD (1024 * 1024) // bytes of transactions per block
+#define TX_RELAY_INTERVAL 100 // ms, transactions received meanwhile are relayed together
+#define TX_RELAY_MAX_BYTES (1024 * 1024) // per message
 
 #endif // CONSTANTS_H
@@ -0,0 +1,374 @@
+#include "blockchain.h"
+#include "headerhasher.h"
+#include "merkletree.h"
+#include "miner.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QSysInfo>
+#include <QThread>
+
+#include <functional>
+#include <iostream>
+
+/**
+ * @brief Micro-benchmarks of the node's hot paths. Results are written in the
+ * JSON layout of Google Benchmark so the usual comparison tools can read them.
+ */
+class BlockchainBenchmark
+{
+public:
+    explicit BlockchainBenchmark(double minTime);
+
+    void run(const QVector<int> &ledgerSizes);
+    QJsonDocument toJson() const;
+
+private:
+    void measure(const QString &name, qint64 itemsPerIteration, const std::function<void()> &iteration);
+    void benchmarkHashing();
+    void benchmarkMining();
+    void benchmarkLedger(int size);
+    void benchmarkPropagation();
+    void benchmarkMempool();
+    static QVector<Transaction> makeTransactions(int count);
+    static QVector<Block> makeLedger(int size);
+    static bool waitFor(const std::function<bool()> &condition);
+
+private:
+    double minTime;
+    QJsonArray results;
+};
+
+
+BlockchainBenchmark::BlockchainBenchmark(double minTime)
+    : minTime(minTime)
+{
+
+}
+
+
+void BlockchainBenchmark::run(const QVector<int> &ledgerSizes)
+{
+    benchmarkHashing();
+    benchmarkMining();
+    for (auto size : ledgerSizes)
+        benchmarkLedger(size);
+    benchmarkMempool();
+    benchmarkPropagation();
+}
+
+
+QJsonDocument BlockchainBenchmark::toJson() const
+{
+    QJsonObject context;
+    context.insert("date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    context.insert("host_name", QSysInfo::machineHostName());
+    context.insert("num_cpus", QThread::idealThreadCount());
+    context.insert("sha256_backend", HeaderHasher::getBackendName());
+    QJsonObject root;
+    root.insert("context", context);
+    root.insert("benchmarks", results);
+    return QJsonDocument(root);
+}
+
+
+/**
+ * @brief Repeats the iteration until minTime seconds have passed.
+ */
+void BlockchainBenchmark::measure(const QString &name, qint64 itemsPerIteration, const std::function<void()> &iteration)
+{
+    QElapsedTimer timer;
+    qint64 iterations = 0;
+    timer.start();
+    do {
+        iteration();
+        iterations++;
+    } while (timer.nsecsElapsed() < minTime * 1e9);
+    double seconds = timer.nsecsElapsed() / 1e9;
+    QJsonObject result;
+    result.insert("name", name);
+    result.insert("iterations", iterations);
+    result.insert("real_time", seconds * 1e9 / iterations);
+    result.insert("time_unit", "ns");
+    result.insert("items_per_second", iterations * itemsPerIteration / seconds);
+    results.append(result);
+    std::cerr << name.toStdString() << ": " << qint64(iterations * itemsPerIteration / seconds) << " items/s" << std::endl;
+}
+
+
+void BlockchainBenchmark::benchmarkHashing()
+{
+    Block legacy(1, QDateTime::currentMSecsSinceEpoch(), "Block 1", QByteArray(), QByteArray(32, '\x11'), 0, DEFAULT_DIFF, Block::LegacyVersion);
+    measure("Block::calculateHash/legacy", 1, [&legacy]() {
+        legacy.setNonce(legacy.getNonce() + 1);
+        legacy.calculateHash();
+    });
+    Block header(legacy);
+    header.setVersion(Block::HeaderVersion);
+    measure("Block::calculateHash/header", 1, [&header]() {
+        header.setNonce(header.getNonce() + 1);
+        header.calculateHash();
+    });
+
+    auto hash = header.calculateHash();
+    measure("Block::getHashDiff", 1, [&hash]() {
+        volatile auto diff = Block::getHashDiff(hash);
+        (void)diff;
+    });
+
+    HeaderHasher hasher(header);
+    qint64 nonce = 0;
+    uchar digest[32];
+    measure("HeaderHasher::hash", 1, [&]() {
+        hasher.hash(nonce++, digest);
+    });
+    quint32 states[8 * HeaderHasher::MaxLanes];
+    measure("HeaderHasher::hashLanes/" + HeaderHasher::getBackendName(), HeaderHasher::getLanes(), [&]() {
+        hasher.hashLanes(nonce, states);
+        nonce += HeaderHasher::getLanes();
+    });
+}
+
+
+/**
+ * @brief Hashes per second for 1, 2, 4 ... threads up to one per core. The
+ * difficulty cannot be met, so each search runs until it is aborted.
+ */
+void BlockchainBenchmark::benchmarkMining()
+{
+    const int maxThreads = std::max(1, QThread::idealThreadCount());
+    for (int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+        std::atomic<bool> abort {false};
+        Miner miner(abort, threads);
+        Block block(1, Transaction::serializeList({Transaction(0, "Block 1")}), QByteArray(32, '\x11'), 0);
+        block.setDifficultySteps(127 * ChainWork::StepsPerBit);
+        block.setTimestamp(QDateTime::currentMSecsSinceEpoch());
+        auto *stopper = QThread::create([&abort, this]() {
+            QThread::msleep(minTime * 1000);
+            abort = true;
+        });
+        QElapsedTimer timer;
+        timer.start();
+        stopper->start();
+        miner.mine(block);
+        double seconds = timer.nsecsElapsed() / 1e9;
+        stopper->wait();
+        delete stopper;
+        QJsonObject result;
+        result.insert("name", "Miner::mine/threads:" + QString::number(threads));
+        result.insert("iterations", 1);
+        result.insert("real_time", seconds * 1e9);
+        result.insert("time_unit", "ns");
+        result.insert("items_per_second", miner.getHashCount() / seconds);
+        results.append(result);
+        std::cerr << "Miner::mine/threads:" << threads << ": " << qint64(miner.getHashCount() / seconds) << " hashes/s" << std::endl;
+        if (threads == maxThreads)
+            break;
+    }
+}
+
+
+void BlockchainBenchmark::benchmarkLedger(int size)
+{
+    auto blocks = makeLedger(size);
+    auto ledger = std::make_shared<const Ledger>(blocks);
+    const auto suffix = "/" + QString::number(size);
+
+    Blockchain source;
+    std::atomic_store(&source.ledger, ledger);
+    QByteArray json;
+    measure("Blockchain::getLedgerJson" + suffix, size, [&]() {
+        json = source.getLedgerJson();
+    });
+    measure("Blockchain::updateLedgerFromJson" + suffix, size, [&]() {
+        // A fresh node, so every block is parsed, validated and hashed
+        Blockchain target;
+        target.updateLedgerFromJson(json);
+    });
+    measure("Blockchain::validateLedger" + suffix, size, [&]() {
+        Blockchain target;
+        target.validateLedger(*ledger);
+    });
+    measure("Ledger::Ledger" + suffix, size, [&]() {
+        // Splits the blocks into headers and payloads and sums the work
+        Ledger copy(blocks);
+    });
+    QByteArray binary;
+    measure("Block::serializeBlocks" + suffix, size, [&]() {
+        binary = Block::serializeBlocks(blocks);
+    });
+    measure("Block::deserializeBlocks" + suffix, size, [&]() {
+        QVector<Block> blocks;
+        Block::deserializeBlocks(binary, blocks);
+    });
+}
+
+
+void BlockchainBenchmark::benchmarkMempool()
+{
+    const int count = 10000;
+    auto transactions = makeTransactions(count);
+    measure("Mempool::add", count, [&]() {
+        Mempool mempool(MEMPOOL_MAX_BYTES);
+        for (const auto &transaction : transactions)
+            mempool.add(transaction);
+    });
+    Mempool mempool(MEMPOOL_MAX_BYTES);
+    for (const auto &transaction : transactions)
+        mempool.add(transaction);
+    auto perBlock = mempool.assemble(BLOCK_MAX_PAYLOAD).size();
+    measure("Mempool::assemble", perBlock, [&]() {
+        mempool.assemble(BLOCK_MAX_PAYLOAD);
+    });
+
+    // Full Merkle root of a block against checking one transaction of it
+    Block block(1, Transaction::serializeList(mempool.assemble(BLOCK_MAX_PAYLOAD)), QByteArray(32, '\x11'), 0);
+    measure("Block::payloadCommitment", perBlock, [&]() {
+        block.payloadCommitment();
+    });
+    auto hashes = Transaction::getHashes(mempool.assemble(BLOCK_MAX_PAYLOAD));
+    auto path = MerkleTree::proof(hashes, hashes.size() / 2);
+    measure("MerkleTree::rootFromProof", 1, [&]() {
+        MerkleTree::rootFromProof(hashes[hashes.size() / 2], hashes.size() / 2, hashes.size(), path);
+    });
+}
+
+
+/**
+ * @brief Time from a block being added on one node until a node following it
+ * over localhost has it as its tip. Blocks are added back to back, so this
+ * includes the coalescing of announcements. Then the transaction throughput:
+ * transactions are submitted to one node, mined into a block and confirmed on
+ * the other.
+ */
+void BlockchainBenchmark::benchmarkPropagation()
+{
+    Blockchain source;
+    Blockchain target;
+    auto port = source.startServer();
+    if (port <= 0 || !target.connectToPeer(DEFAULT_PEER_HOST, port)
+            || !waitFor([&target]() { return target.peerManager.connectedCount() > 0; })) {
+        std::cerr << "Blockchain::propagation: could not connect the nodes" << std::endl;
+        return;
+    }
+    measure("Blockchain::propagation", 1, [&]() {
+        auto tip = source.getLedger();
+        auto index = tip->isEmpty() ? 0 : tip->back().index + 1;
+        Block block(index, Transaction::serializeList({Transaction(0, "Block " + QByteArray::number(index))}), tip->isEmpty() ? QByteArray() : tip->back().getHash(), 0);
+        block.setTimestamp(QDateTime::currentMSecsSinceEpoch());
+        block.setNonce(0);
+        block.setHash(block.calculateHash());
+        source.addBlock(block);
+        waitFor([&target, &block]() {
+            auto ledger = target.getLedger();
+            return !ledger->isEmpty() && ledger->back().isHash(block.getHash());
+        });
+    });
+
+    const int batch = 1000;
+    int round = 0;
+    measure("Blockchain::transactions", batch, [&]() {
+        for (const auto &transaction : makeTransactions(batch)) {
+            // Different data each round, so nothing is deduplicated
+            source.submitTransaction(Transaction(transaction.getFee(), transaction.getData() + QByteArray::number(round)));
+        }
+        round++;
+        auto tip = source.getLedger();
+        auto index = tip->back().index + 1;
+        Block block(index, Transaction::serializeList(source.mempool.assemble(BLOCK_MAX_PAYLOAD)), tip->back().getHash(), 0);
+        block.setTimestamp(QDateTime::currentMSecsSinceEpoch());
+        block.setNonce(0);
+        block.setHash(block.calculateHash());
+        source.addBlock(block);
+        waitFor([&target, &block]() {
+            return target.getLedger()->back().isHash(block.getHash());
+        });
+    });
+}
+
+
+/**
+ * @brief Runs the event loop until the condition holds, false after WAIT_TIME.
+ */
+bool BlockchainBenchmark::waitFor(const std::function<bool()> &condition)
+{
+    QElapsedTimer timer;
+    timer.start();
+    while (!condition()) {
+        if (timer.elapsed() > WAIT_TIME)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents, 1);
+    }
+    return true;
+}
+
+
+/**
+ * @brief Transactions of about 200 bytes with fees spread over 100 values.
+ */
+QVector<Transaction> BlockchainBenchmark::makeTransactions(int count)
+{
+    QVector<Transaction> transactions;
+    transactions.reserve(count);
+    for (int i = 0; i < count; i++)
+        transactions.push_back(Transaction(i % 100, QByteArray(192, char(i)) + QByteArray::number(i)));
+    return transactions;
+}
+
+
+/**
+ * @brief Valid ledger at difficulty 0, so any nonce is accepted.
+ */
+QVector<Block> BlockchainBenchmark::makeLedger(int size)
+{
+    QVector<Block> ledger;
+    ledger.reserve(size);
+    auto timestamp = QDateTime::currentMSecsSinceEpoch() - size;
+    QByteArray prevHash;
+    for (int i = 0; i < size; i++) {
+        Block block(i, Transaction::serializeList({Transaction(0, "Block " + QByteArray::number(i))}), prevHash, 0);
+        block.setTimestamp(timestamp + i);
+        block.setNonce(0);
+        block.setHash(block.calculateHash());
+        prevHash = block.getHash();
+        ledger.push_back(block);
+    }
+    return ledger;
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("SimpleBlockchainBenchmark");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simple Blockchain benchmarks");
+    parser.addHelpOption();
+    QCommandLineOption outOption("out", "Write the JSON results to a file instead of stdout.", "file");
+    QCommandLineOption minTimeOption("min-time", "Minimum seconds per benchmark.", "seconds", "0.5");
+    QCommandLineOption sizesOption("sizes", "Comma-separated ledger sizes.", "sizes", "1000,10000,100000");
+    parser.addOptions({outOption, minTimeOption, sizesOption});
+    parser.process(a);
+
+    QVector<int> sizes;
+    for (const auto &size : parser.value(sizesOption).split(',', Qt::SkipEmptyParts))
+        sizes.push_back(size.toInt());
+
+    BlockchainBenchmark benchmark(parser.value(minTimeOption).toDouble());
+    benchmark.run(sizes);
+    auto json = benchmark.toJson().toJson();
+
+    if (!parser.isSet(outOption)) {
+        std::cout << json.toStdString();
+        return 0;
+    }
+    QFile file(parser.value(outOption));
+    if (!file.open(QIODevice::WriteOnly))
+        return 1;
+    file.write(json);
+    return 0;
+}
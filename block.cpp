@@ -1,6 +1,10 @@
 #include "block.h"
+#include "merkletree.h"
+#include "transaction.h"
 
-Block::Block(qint64 index, const QByteArray &data, const QByteArray &prevHash, qint8 difficulty) :
+#include <limits>
+
+Block::Block(qint64 index, const QByteArray &data, const QByteArray &prevHash, qint32 difficulty) :
     nonce(-1)
   , index(index)
   , data(data)
@@ -10,7 +14,7 @@ Block::Block(qint64 index, const QByteArray &data, const QByteArray &prevHash, q
 
 }
 
-Block::Block(qint64 index, qint64 timestamp, QByteArray data, QByteArray hash, QByteArray prevHash, qint64 nonce, qint8 difficulty)
+Block::Block(qint64 index, qint64 timestamp, QByteArray data, QByteArray hash, QByteArray prevHash, qint64 nonce, qint32 difficulty, qint32 version)
     : index(index)
     , timestamp(timestamp)
     , data(data)
@@ -18,11 +22,25 @@ Block::Block(qint64 index, qint64 timestamp, QByteArray data, QByteArray hash, Q
     , prevHash(prevHash)
     , nonce(nonce)
     , difficulty(difficulty)
+    , version(version)
 
 {
 
 }
 
+Block::Block(const BlockHeader &header, const QByteArray &data)
+    : index(header.index)
+    , timestamp(header.timestamp)
+    , data(data)
+    , hash(header.getHash())
+    , prevHash(header.getPrevHash())
+    , nonce(header.nonce)
+    , difficulty(header.difficulty)
+    , version(header.version)
+{
+
+}
+
 qint64 Block::getIndex() const
 {
     return index;
@@ -33,7 +51,7 @@ void Block::setIndex(qint64 newIndex)
     index = newIndex;
 }
 
-QByteArray Block::getData() const
+const QByteArray &Block::getData() const
 {
     return data;
 }
@@ -43,7 +61,7 @@ void Block::setData(const QByteArray &newData)
     data = newData;
 }
 
-QByteArray Block::getHash() const
+const QByteArray &Block::getHash() const
 {
     return hash;
 }
@@ -53,7 +71,7 @@ void Block::setHash(const QByteArray &newHash)
     hash = newHash;
 }
 
-QByteArray Block::getPrevHash() const
+const QByteArray &Block::getPrevHash() const
 {
     return prevHash;
 }
@@ -84,21 +102,134 @@ void Block::setNonce(qint64 newNonce)
     nonce = newNonce;
 }
 
-qint8 Block::getDifficulty() const
+/**
+ * @brief The difficulty as stored in the header, see getDifficultySteps() for a comparable value.
+ */
+qint32 Block::getDifficulty() const
 {
     return difficulty;
 }
 
-void Block::setDifficulty(qint8 newDifficulty)
+void Block::setDifficulty(qint32 newDifficulty)
 {
     difficulty = newDifficulty;
 }
 
+qint32 Block::getDifficultySteps() const
+{
+    return toDifficultySteps(difficulty, version);
+}
+
+/**
+ * @brief Sets the difficulty in steps of 1/ChainWork::StepsPerBit. Versions
+ * before TargetVersion only store whole bits, the steps are rounded up.
+ */
+void Block::setDifficultySteps(qint32 steps)
+{
+    if (version >= TargetVersion)
+        difficulty = steps;
+    else
+        difficulty = steps > 0 ? (steps + ChainWork::StepsPerBit - 1) / ChainWork::StepsPerBit : steps / ChainWork::StepsPerBit;
+}
+
+qint32 Block::getVersion() const
+{
+    return version;
+}
+
+void Block::setVersion(qint32 newVersion)
+{
+    version = newVersion;
+}
+
+/**
+ * @brief Fills the header from this block.
+ * @return False if a hash is neither empty nor 32 bytes long
+ */
+bool Block::getHeader(BlockHeader &header) const
+{
+    if ((hash.size() != 0 && hash.size() != 32) || (prevHash.size() != 0 && prevHash.size() != 32))
+        return false;
+    header.index = index;
+    header.timestamp = timestamp;
+    header.nonce = nonce;
+    header.version = version;
+    header.difficulty = difficulty;
+    header.flags = 0;
+    header.hash.fill(0);
+    header.prevHash.fill(0);
+    if (!hash.isEmpty()) {
+        memcpy(header.hash.data(), hash.constData(), 32);
+        header.flags |= BlockHeader::HasHash;
+    }
+    if (!prevHash.isEmpty()) {
+        memcpy(header.prevHash.data(), prevHash.constData(), 32);
+        header.flags |= BlockHeader::HasPrevHash;
+    }
+    return true;
+}
+
 QByteArray Block::calculateHash() const
 {
-    QByteArray temp;
-    temp = QByteArray::number(index) + QByteArray::number(timestamp) + data + prevHash + QByteArray::number(difficulty) + QByteArray::number(nonce);
-    return QCryptographicHash::hash(temp, QCryptographicHash::Sha256);
+    if (version == LegacyVersion) {
+        QByteArray temp;
+        temp = QByteArray::number(index) + QByteArray::number(timestamp) + data + prevHash + QByteArray::number(difficulty) + QByteArray::number(nonce);
+        return QCryptographicHash::hash(temp, QCryptographicHash::Sha256);
+    }
+    if (version >= HeaderVersion && version <= TargetVersion) {
+        uchar header[HeaderSize];
+        if (!writeHeader(header))
+            return {};
+        return QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char *>(header), HeaderSize), QCryptographicHash::Sha256);
+    }
+    return {};
+}
+
+/**
+ * @brief Checks that the hash matches the block and meets its difficulty.
+ */
+bool Block::verifyHash() const
+{
+    if (calculateHash() != hash || hash.size() != 32)
+        return false;
+    return meetsDifficulty(reinterpret_cast<const uchar *>(hash.constData()), getDifficultySteps());
+}
+
+/**
+ * @brief Writes the binary header hashed by all blocks after LegacyVersion. All fields are big-endian:
+ * version (4), index (8), timestamp (8), prevHash (32), payloadCommitment() (32), difficulty (4), nonce (8).
+ * The first 64 bytes do not depend on the nonce, so their SHA-256 state can be cached while mining.
+ * @param header Buffer of HeaderSize bytes
+ * @return False if the payload of a Merkle block is not a transaction list
+ */
+bool Block::writeHeader(uchar *header) const
+{
+    auto commitment = payloadCommitment();
+    qToBigEndian<quint32>(version, header);
+    qToBigEndian<quint64>(index, header + 4);
+    qToBigEndian<quint64>(timestamp, header + 12);
+    memset(header + 20, 0, 64);
+    memcpy(header + 20, prevHash.constData(), std::min<qsizetype>(prevHash.size(), 32));
+    memcpy(header + HeaderCommitmentOffset, commitment.constData(), commitment.size());
+    qToBigEndian<quint32>(difficulty, header + 84);
+    qToBigEndian<quint64>(nonce, header + HeaderNonceOffset);
+    return !commitment.isEmpty();
+}
+
+/**
+ * @brief What the header commits to: the Merkle root of the transaction hashes
+ * from MerkleVersion on, so one transaction can be proven without the others,
+ * sha256(data) before.
+ * @return Empty if the payload of a Merkle block is not a transaction list
+ */
+QByteArray Block::payloadCommitment() const
+{
+    if (version < MerkleVersion)
+        return QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+    QVector<Transaction> transactions;
+    if (!Transaction::deserializeList(data, transactions))
+        return {};
+    return MerkleTree::root(Transaction::getHashes(transactions));
 }
 
 QString Block::getHashString(QByteArray hash)
@@ -107,36 +238,281 @@ QString Block::getHashString(QByteArray hash)
 }
 
 qint8 Block::getHashDiff(const QByteArray &hash)
+{
+    return getHashDiff(reinterpret_cast<const uchar *>(hash.constData()), hash.size());
+}
+
+qint8 Block::getHashDiff(const uchar *hash, int size)
 {
     int counter = 0;
-    bool bit = false;
-    for (const auto &c: hash) {
-        if (bit)
-            break;
-        auto mask = 0b10000000;
-        for (int i = 0; i < 8; i++) {
-            bit = mask & c;
-            if (bit)
-                break;
-            mask >>= 1;
-            counter++;
-        }
+    int i = 0;
+    for (; i + 8 <= size; i += 8) {
+        auto word = qFromBigEndian<quint64>(hash + i);
+        if (word)
+            return counter + qCountLeadingZeroBits(word);
+        counter += 64;
+    }
+    for (; i < size; i++) {
+        if (hash[i])
+            return counter + qCountLeadingZeroBits(quint8(hash[i]));
+        counter += 8;
+    }
+    return counter;
+}
+
+/**
+ * @brief Leading zero bits of a SHA-256 state, words stored with the given stride.
+ */
+qint8 Block::getHashDiff(const quint32 *state, int stride)
+{
+    int counter = 0;
+    for (int i = 0; i < 8; i++) {
+        auto word = state[i * stride];
+        if (word)
+            return counter + qCountLeadingZeroBits(word);
+        counter += 32;
     }
     return counter;
 }
 
+/**
+ * @brief Checks a hash against a difficulty of z bits and f steps: the first z
+ * bits must be zero and the 8 bits after them below 256 - f, so the hash is
+ * below (256 - f) * 2^(248 - z).
+ */
+bool Block::meetsDifficulty(const uchar *hash, qint32 steps)
+{
+    if (steps <= 0)
+        return true;
+    auto zeros = steps / ChainWork::StepsPerBit;
+    auto fraction = steps % ChainWork::StepsPerBit;
+    if (zeros > 256)
+        return false;
+    for (int i = 0; i < zeros / 8; i++) {
+        if (hash[i])
+            return false;
+    }
+    if (zeros % 8 && hash[zeros / 8] >> (8 - zeros % 8))
+        return false;
+    auto byteAt = [hash](int i) {
+        return i < 32 ? hash[i] : 0;
+    };
+    int window = ((byteAt(zeros / 8) << 8 | byteAt(zeros / 8 + 1)) >> (8 - zeros % 8)) & 0xff;
+    return window < ChainWork::StepsPerBit - fraction;
+}
+
+/**
+ * @brief Difficulty in steps of 1/ChainWork::StepsPerBit for a difficulty
+ * stored by the given block version.
+ */
+qint32 Block::toDifficultySteps(qint32 difficulty, qint32 version)
+{
+    if (version >= TargetVersion)
+        return difficulty;
+    return difficulty * ChainWork::StepsPerBit;
+}
+
 QString Block::toQString() const
 {
-    std::stringstream stream;
-    QDateTime datetime;
-    datetime.setMSecsSinceEpoch(getTimestamp());
-    stream << "Index: " << (int)getIndex() << "\n";
-    stream << "Timestamp: " << datetime.toString().toStdString() << "\n";
-    stream << "Data: " << getData().toStdString() << "\n";
-    stream << "Prev hash: " << getHashString(getPrevHash()).toStdString() << "\n";
-    stream << "Hash: " << getHashString(getHash()).toStdString() << "\n";
-    stream << "Nonce: " << (int)getNonce() << "\n";
-    stream << "Difficulty: " << (int)getDifficulty();
-    stream.flush();
-    return {stream.str().c_str()};
+    return "Index: " + QString::number(getIndex())
+            + "\nTimestamp: " + QDateTime::fromMSecsSinceEpoch(getTimestamp()).toString()
+            + "\nData: " + QString::fromUtf8(getData())
+            + "\nPrev hash: " + getHashString(getPrevHash())
+            + "\nHash: " + getHashString(getHash())
+            + "\nNonce: " + QString::number(getNonce())
+            + "\nDifficulty: " + QString::number(getDifficultySteps() / double(ChainWork::StepsPerBit), 'f', 2);
+}
+
+QJsonObject Block::toJson() const
+{
+    QJsonObject json;
+    json.insert("index", index);
+    json.insert("timestamp", timestamp);
+    json.insert("data", QJsonValue::fromVariant(QVariant::fromValue(data.toBase64())));
+    json.insert("hash", QJsonValue::fromVariant(QVariant::fromValue(hash.toBase64())));
+    json.insert("prevHash", QJsonValue::fromVariant(QVariant::fromValue(prevHash.toBase64())));
+    json.insert("nonce", nonce);
+    json.insert("difficulty", difficulty);
+    json.insert("version", version);
+    return json;
+}
+
+Block Block::fromJson(const QJsonObject &json)
+{
+    return {json.value("index").toInteger(),
+            json.value("timestamp").toInteger(),
+            QByteArray::fromBase64(json.value("data").toVariant().value<QByteArray>()),
+            QByteArray::fromBase64(json.value("hash").toVariant().value<QByteArray>()),
+            QByteArray::fromBase64(json.value("prevHash").toVariant().value<QByteArray>()),
+            json.value("nonce").toInteger(),
+            qint32(json.value("difficulty").toInteger()),
+            json.value("version").toInt(LegacyVersion)};
+}
+
+/**
+ * @brief Appends the binary encoding: hash version, index, timestamp and nonce
+ * as varints, difficulty (a byte before TargetVersion, a signed varint from it on),
+ * a flags byte for which hashes are present, the raw
+ * 32-byte hashes and the length-prefixed data. Hashes are empty or 32 bytes,
+ * anything else is written as empty and fails validation on the other side.
+ */
+void Block::serialize(QByteArray &out) const
+{
+    const bool hasHash = hash.size() == 32;
+    const bool hasPrevHash = prevHash.size() == 32;
+    Serializer::writeVarint(out, quint32(version));
+    Serializer::writeSigned(out, index);
+    Serializer::writeSigned(out, timestamp);
+    Serializer::writeSigned(out, nonce);
+    if (version >= TargetVersion)
+        Serializer::writeSigned(out, difficulty);
+    else
+        out.append(char(difficulty));
+    out.append(char((hasHash ? 1 : 0) | (hasPrevHash ? 2 : 0)));
+    if (hasHash)
+        out.append(hash);
+    if (hasPrevHash)
+        out.append(prevHash);
+    Serializer::writeBytes(out, data);
+}
+
+bool Block::deserialize(Serializer::Reader &reader, Block &block)
+{
+    quint64 version;
+    quint8 flags;
+    if (!reader.readVarint(version) || version > quint64(std::numeric_limits<qint32>::max()))
+        return false;
+    block.version = qint32(version);
+    if (!reader.readSigned(block.index) || !reader.readSigned(block.timestamp) || !reader.readSigned(block.nonce))
+        return false;
+    if (block.version >= TargetVersion) {
+        qint64 difficulty;
+        if (!reader.readSigned(difficulty) || difficulty != qint32(difficulty))
+            return false;
+        block.difficulty = qint32(difficulty);
+    } else {
+        quint8 difficulty;
+        if (!reader.readByte(difficulty))
+            return false;
+        block.difficulty = qint8(difficulty);
+    }
+    if (!reader.readByte(flags))
+        return false;
+    block.hash.clear();
+    block.prevHash.clear();
+    if ((flags & 1) && !reader.readRaw(block.hash, 32))
+        return false;
+    if ((flags & 2) && !reader.readRaw(block.prevHash, 32))
+        return false;
+    return reader.readBytes(block.data);
+}
+
+/**
+ * @brief Encodes a ledger range: format version, block count, then the blocks.
+ */
+QByteArray Block::serializeBlocks(const QVector<Block> &blocks)
+{
+    QByteArray out;
+    qsizetype size = 16;
+    for (const auto &block : blocks)
+        size += 96 + block.data.size();
+    out.reserve(size);
+    out.append(char(SerialFormat));
+    Serializer::writeVarint(out, blocks.size());
+    for (const auto &block : blocks)
+        block.serialize(out);
+    return out;
+}
+
+bool Block::deserializeBlocks(const QByteArray &bytes, QVector<Block> &blocks)
+{
+    Serializer::Reader reader(bytes);
+    quint8 format;
+    quint64 count;
+    if (!reader.readByte(format) || format != SerialFormat || !reader.readVarint(count))
+        return false;
+    // Every block takes at least 7 bytes, do not trust larger counts
+    if (count > quint64(bytes.size()) / 7)
+        return false;
+    blocks.reserve(blocks.size() + count);
+    for (quint64 i = 0; i < count; i++) {
+        Block block;
+        if (!deserialize(reader, block))
+            return false;
+        blocks.push_back(std::move(block));
+    }
+    return reader.atEnd();
+}
+
+bool Block::operator==(const Block &other) const
+{
+    return index == other.index
+            && timestamp == other.timestamp
+            && nonce == other.nonce
+            && difficulty == other.difficulty
+            && version == other.version
+            && hash == other.hash
+            && prevHash == other.prevHash
+            && data == other.data;
+}
+
+bool Block::operator!=(const Block &other) const
+{
+    return !(*this == other);
+}
+
+QByteArray BlockHeader::getHash() const
+{
+    if (!(flags & HasHash))
+        return {};
+    return QByteArray(reinterpret_cast<const char *>(hash.data()), hash.size());
+}
+
+qint32 BlockHeader::getDifficultySteps() const
+{
+    return Block::toDifficultySteps(difficulty, version);
+}
+
+QByteArray BlockHeader::getPrevHash() const
+{
+    if (!(flags & HasPrevHash))
+        return {};
+    return QByteArray(reinterpret_cast<const char *>(prevHash.data()), prevHash.size());
+}
+
+/**
+ * @brief Compares the block hash with the given one without copying it.
+ */
+bool BlockHeader::isHash(const QByteArray &other) const
+{
+    if (!(flags & HasHash))
+        return other.isEmpty();
+    return other.size() == 32 && memcmp(hash.data(), other.constData(), 32) == 0;
+}
+
+/**
+ * @brief True if this block points to the given one.
+ */
+bool BlockHeader::follows(const BlockHeader &prev) const
+{
+    if ((flags & HasPrevHash) != ((prev.flags & HasHash) ? HasPrevHash : 0))
+        return false;
+    return prevHash == prev.hash;
+}
+
+bool BlockHeader::operator==(const BlockHeader &other) const
+{
+    return index == other.index
+            && timestamp == other.timestamp
+            && nonce == other.nonce
+            && difficulty == other.difficulty
+            && version == other.version
+            && flags == other.flags
+            && hash == other.hash
+            && prevHash == other.prevHash;
+}
+
+bool BlockHeader::operator!=(const BlockHeader &other) const
+{
+    return !(*this == other);
 }
@@ -6,34 +6,80 @@
 #include <QCryptographicHash>
 #include <QString>
 #include <QDateTime>
+#include <QJsonObject>
+#include <QVector>
+#include <QtEndian>
+#include <QtAlgorithms>
+#include <array>
 #include <sstream>
 
+#include "chainwork.h"
+#include "serializer.h"
+
+struct BlockHeader;
+
 class Block
 {
 public:
+    // Hash formats
+    enum Version : qint32 {
+        LegacyVersion = 1, // Decimal fields and raw data concatenated
+        HeaderVersion = 2, // Fixed-layout binary header, nonce last
+        MerkleVersion = 3, // Same header, committing to the Merkle root of the transactions
+        TargetVersion = 4  // Merkle header, difficulty in steps of 1/256 bit
+    };
+    static constexpr qint32 CurrentVersion = TargetVersion;
+    static constexpr int HeaderSize = 96;
+    static constexpr int HeaderCommitmentOffset = 52;
+    static constexpr int HeaderNonceOffset = 88;
+    static constexpr quint8 SerialFormat = 1;
+
     Block() = default;
-    Block(qint64 index, const QByteArray &data, const QByteArray &prevHash, qint8 difficulty);
-    Block(qint64 index, qint64 timestamp, QByteArray data, QByteArray hash, QByteArray prevHash, qint64 nonce, qint8 difficulty);
+    Block(qint64 index, const QByteArray &data, const QByteArray &prevHash, qint32 difficulty);
+    Block(qint64 index, qint64 timestamp, QByteArray data, QByteArray hash, QByteArray prevHash, qint64 nonce, qint32 difficulty, qint32 version = LegacyVersion);
+    Block(const BlockHeader &header, const QByteArray &data);
 
     qint64 getIndex() const;
     void setIndex(qint64 newIndex);
-    QByteArray getData() const;
+    const QByteArray &getData() const;
     void setData(const QByteArray &newData);
-    QByteArray getHash() const;
+    const QByteArray &getHash() const;
     void setHash(const QByteArray &newHash);
-    QByteArray getPrevHash() const;
+    const QByteArray &getPrevHash() const;
     void setPrevHash(const QByteArray &newPrevHash);
     qint64 getTimestamp() const;
     void setTimestamp(qint64 newTimestamp);
     qint64 getNonce() const;
     void setNonce(qint64 newNonce);
-    qint8 getDifficulty() const;
-    void setDifficulty(qint8 newDifficulty);
+    qint32 getDifficulty() const;
+    void setDifficulty(qint32 newDifficulty);
+    qint32 getDifficultySteps() const;
+    void setDifficultySteps(qint32 steps);
+    qint32 getVersion() const;
+    void setVersion(qint32 newVersion);
+
+    bool getHeader(BlockHeader &header) const;
 
     QByteArray calculateHash() const;
+    bool verifyHash() const;
+    bool writeHeader(uchar *header) const;
+    QByteArray payloadCommitment() const;
     static QString getHashString(QByteArray hash);
     static qint8 getHashDiff(const QByteArray &hash);
+    static qint8 getHashDiff(const uchar *hash, int size);
+    static qint8 getHashDiff(const quint32 *state, int stride = 1);
+    static bool meetsDifficulty(const uchar *hash, qint32 steps);
+    static qint32 toDifficultySteps(qint32 difficulty, qint32 version);
     QString toQString() const;
+    QJsonObject toJson() const;
+    static Block fromJson(const QJsonObject &json);
+    void serialize(QByteArray &out) const;
+    static bool deserialize(Serializer::Reader &reader, Block &block);
+    static QByteArray serializeBlocks(const QVector<Block> &blocks);
+    static bool deserializeBlocks(const QByteArray &bytes, QVector<Block> &blocks);
+
+    bool operator==(const Block &other) const;
+    bool operator!=(const Block &other) const;
 
 private:
     qint64 index;
@@ -42,7 +88,39 @@ private:
     QByteArray hash;
     QByteArray prevHash;
     qint64 nonce;
-    qint8 difficulty;
+    qint32 difficulty;       // Whole bits before TargetVersion, steps from it on
+    qint32 version {CurrentVersion};
+};
+
+/**
+ * @brief Block metadata without the payload. Hashes are stored inline so a
+ * chain of headers is one contiguous array.
+ */
+struct BlockHeader
+{
+    typedef std::array<uchar, 32> Hash;
+    enum Flags : quint8 {
+        HasHash = 1,
+        HasPrevHash = 2
+    };
+
+    qint64 index {0};
+    qint64 timestamp {0};
+    qint64 nonce {0};
+    Hash hash {};
+    Hash prevHash {};
+    qint32 version {Block::CurrentVersion};
+    qint32 difficulty {0};
+    quint8 flags {0};
+
+    QByteArray getHash() const;
+    qint32 getDifficultySteps() const;
+    QByteArray getPrevHash() const;
+    bool isHash(const QByteArray &other) const;
+    bool follows(const BlockHeader &prev) const;
+
+    bool operator==(const BlockHeader &other) const;
+    bool operator!=(const BlockHeader &other) const;
 };
 
 #endif // BLOCK_H
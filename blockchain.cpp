@@ -1,35 +1,47 @@
 #include "blockchain.h"
 #include "Constants.h"
+#include "merkletree.h"
+#include <QElapsedTimer>
+#include <QSemaphore>
 #include <QThread>
+#include <utility>
 
 
 Blockchain::Blockchain(QObject *parent)
     : _server(nullptr)
-    , _socket(nullptr)
     , QObject{parent}
-    , debug(qDebug())
-    , timer(nullptr)
+    , tree(MAX_ORPHAN_BLOCKS)
+    , miner(updated, DEFAULT_MINER_THREADS)
 {
-    debug.noquote();
-    debug.nospace();
     connect(this, SIGNAL(broadcastLedger()), this, SLOT(onBroadcastLedger()));
+    // Tips are announced when they change, the keepalive only covers idle periods
+    connect(&keepaliveTimer, SIGNAL(timeout()), this, SLOT(onBroadcastLedger()));
+    keepaliveTimer.start(KEEPALIVE_INTERVAL);
+    connect(&announceTimer, SIGNAL(timeout()), this, SLOT(onAnnounceTip()));
+    announceTimer.setSingleShot(true);
+    connect(&relayTimer, SIGNAL(timeout()), this, SLOT(onRelayTransactions()));
+    relayTimer.setSingleShot(true);
+    relayTimer.setInterval(TX_RELAY_INTERVAL);
+    connect(&peerManager, SIGNAL(peerConnected(QTcpSocket*)), this, SLOT(onPeerConnected(QTcpSocket*)));
+    connect(&peerManager, SIGNAL(peerDisconnected(QTcpSocket*)), this, SLOT(onPeerDisconnected(QTcpSocket*)));
+    connect(&peerManager, SIGNAL(peerUnreachable(QString,quint16,qint64)), this, SLOT(onPeerUnreachable(QString,quint16,qint64)));
+    connect(this, SIGNAL(batchValidated(quint64,bool)), this, SLOT(onBatchValidated(quint64,bool)), Qt::QueuedConnection);
+    validationPool.setMaxThreadCount(1);
+    registerMetrics();
 }
 
 
 Blockchain::~Blockchain()
 {
+    validationPool.waitForDone();
     if (_server) {
         _server->deleteLater();
         _server = nullptr;
     }
-    if (_socket) {
-        _socket->deleteLater();
-        _socket = nullptr;
-    }
 }
 
 
-qint16 Blockchain::startServer()
+qint32 Blockchain::startServer(quint16 port)
 {
     if (_server) {
         emit messageSent("Server already running!", Qt::yellow);
@@ -37,7 +49,7 @@ qint16 Blockchain::startServer()
     }
     _server = new QTcpServer(this);
     connect(_server, SIGNAL(newConnection()), this, SLOT(onNewConnectionServer()));
-    if (_server->listen(QHostAddress::Any)) {
+    if (_server->listen(QHostAddress::Any, port)) {
         emit messageSent("Server started on port ...", Qt::gray);
     } else {
         emit messageSent("Server could not start!", Qt::red);
@@ -45,47 +57,60 @@ qint16 Blockchain::startServer()
         _server = nullptr;
         return 0;
     }
-    // Start a timer to relay updates
-    if (timer) {
-        timer->stop();
-        timer->deleteLater();
-        timer = nullptr;
-    }
-    QTimer *timer = new QTimer(this);
-    connect(timer, SIGNAL(timeout()), this, SLOT(onBroadcastLedger()));
-    timer->start(LEDGER_UPDATE_TIME);
-
     return _server->serverPort();
 }
 
 
-bool Blockchain::connectToPort(qint64 port)
+/**
+ * @brief Follows another node. Returns right away, the connection is made in
+ * the background and kept up for as long as we run.
+ * @return False if the peer is followed already
+ */
+bool Blockchain::connectToPeer(const QString &host, quint16 port)
 {
-    if (_socket) {
-        emit messageSent("Already connected!", Qt::yellow);
-    }
-    _socket = new QTcpSocket(this);
-    _socket->connectToHost(LOCALHOST, port);
-    if (_socket->waitForConnected(WAIT_TIME)) {
-        emit messageSent("Socket connected to: " + QString::number(port), Qt::green);
-    } else {
-        emit messageSent("Socket could not connect!", Qt::red);
-        _socket->deleteLater();
-        _socket = nullptr;
+    if (!peerManager.addPeer(host, port)) {
+        emit messageSent("Already connected to " + host + ":" + QString::number(port) + "!", Qt::yellow);
         return false;
     }
-    connect(_socket, SIGNAL(readyRead()), this, SLOT(onReadyReadClient()));
-    connect(_socket, SIGNAL(disconnected()), this, SLOT(onDisconnectedClient()));
+    emit messageSent("Connecting to " + host + ":" + QString::number(port) + "...", Qt::gray);
     return true;
 }
 
 
+void Blockchain::onPeerConnected(QTcpSocket *server)
+{
+    connect(server, SIGNAL(readyRead()), this, SLOT(onReadyReadClient()));
+    connect(server, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten()));
+    auto &state = peers[server];
+    state.id = ++lastPeerId;
+    state.outbound = true;
+    emit messageSent("Socket connected to: " + peerName(server), Qt::green);
+}
+
+
+void Blockchain::onPeerDisconnected(QTcpSocket *server)
+{
+    emit messageSent(peerName(server) + " has disconnected!", Qt::red);
+    peers.remove(server);
+}
+
+
+void Blockchain::onPeerUnreachable(QString host, quint16 port, qint64 retryDelay)
+{
+    emit messageSent("Could not connect to " + host + ":" + QString::number(port) + ", retrying in " + QString::number(retryDelay / 1000) + " s", Qt::red);
+}
+
+
 void Blockchain::onNewConnectionServer()
 {
     auto *client = _server->nextPendingConnection();
     connect(client, SIGNAL(readyRead()), this, SLOT(onReadyReadServer()));
     connect(client, SIGNAL(disconnected()), this, SLOT(onDisconnectedServer()));
-    emit messageSent(QString("(S) Client connected: ") + QString("localhost:") + QString::number(client->peerPort()), Qt::green);
+    connect(client, SIGNAL(bytesWritten(qint64)), this, SLOT(onBytesWritten()));
+    PeerState state;
+    state.id = ++lastPeerId;
+    peers.insert(client, state);
+    emit messageSent(QString("(S) Client connected: ") + peerName(client), Qt::green);
     clients.append(client);
 }
 
@@ -93,8 +118,9 @@ void Blockchain::onNewConnectionServer()
 void Blockchain::onDisconnectedServer()
 {
     auto *client = reinterpret_cast<QTcpSocket *>(sender());
-    emit messageSent("Cleint " + QString(LOCALHOST) + ":" + QString::number(client->peerPort()) +  + " has disconnected!", Qt::red);
+    emit messageSent("Cleint " + peerName(client) + " has disconnected!", Qt::red);
     clients.removeAt(clients.indexOf(client));
+    peers.remove(client);
     client->deleteLater();
 }
 
@@ -102,38 +128,526 @@ void Blockchain::onDisconnectedServer()
 void Blockchain::onReadyReadServer()
 {
     auto *client = reinterpret_cast<QTcpSocket *>(sender());
-    auto data = client->readAll();
-    updateLedgerFromJson(data);
+    readFrames(client);
 }
 
 
 void Blockchain::onReadyReadClient()
 {
     auto *server = reinterpret_cast<QTcpSocket *>(sender());
-    auto data = server->readAll();
-    updateLedgerFromJson(data);
-    server->write(getLedgerJson());
+    readFrames(server);
 }
 
 
-void Blockchain::onDisconnectedClient()
+/**
+ * @brief Sends what was held back from a lagging peer once its buffer drained.
+ */
+void Blockchain::onBytesWritten()
 {
-    auto *server = reinterpret_cast<QTcpSocket *>(sender());
-    emit messageSent(QString(LOCALHOST) + ":" + QString::number(server->peerPort()) + " has disconnected!", Qt::red);
-    if (_socket == server) {
-        _socket->deleteLater();
-        _socket = nullptr;
-    }
+    auto *peer = reinterpret_cast<QTcpSocket *>(sender());
+    auto state = peers.find(peer);
+    if (state == peers.end() || !state->lagging || peer->bytesToWrite() > PEER_WRITE_LOW_WATERMARK)
+        return;
+    state->lagging = false;
+    auto ledgerPending = std::exchange(state->ledgerPending, false);
+    auto tipPending = std::exchange(state->tipPending, false);
+    if (ledgerPending)
+        send(peer, Protocol::Ledger, getLedgerJson());
+    if (tipPending)
+        send(peer, Protocol::Tip, Protocol::encodeTip(getTip()));
 }
 
+
+/**
+ * @brief Sends our tip to every peer, and the full ledger to clients on the old protocol.
+ */
 void Blockchain::onBroadcastLedger()
 {
-    if (_server && _server->isListening()) {
-        auto json = getLedgerJson();
-        for (const auto &client: clients) {
-            client->write(json);
+    QElapsedTimer timer;
+    timer.start();
+    auto tip = Protocol::encodeTip(getTip());
+    QByteArray json;
+    for (auto it = peers.cbegin(); it != peers.cend(); ++it) {
+        if (it->legacy) {
+            // Servers on the old protocol get our ledger as the reply to theirs
+            if (it->outbound)
+                continue;
+            if (json.isEmpty())
+                json = getLedgerJson();
+            send(it.key(), Protocol::Ledger, json);
+        } else {
+            send(it.key(), Protocol::Tip, tip);
         }
     }
+    networkTime += timer.nsecsElapsed();
+}
+
+
+/**
+ * @brief Announces a new tip, at most once per ANNOUNCE_MIN_INTERVAL so a burst
+ * of blocks or a reorg goes out as one announcement of the final tip.
+ */
+void Blockchain::onAnnounceTip()
+{
+    auto now = QDateTime::currentMSecsSinceEpoch();
+    auto wait = lastAnnouncement + ANNOUNCE_MIN_INTERVAL - now;
+    if (wait > 0) {
+        announceTimer.start(wait);
+        return;
+    }
+    auto delay = now - tipChangedAt;
+    announcePending = false;
+    lastAnnouncement = now;
+    onBroadcastLedger();
+    emit tipAnnounced(getLedger()->size() - 1, delay);
+}
+
+
+/**
+ * @brief Schedules onAnnounceTip() on the event loop, from any thread. Calls
+ * made before it runs are merged into it.
+ */
+void Blockchain::requestAnnouncement()
+{
+    if (announcePending.exchange(true))
+        return;
+    tipChangedAt = QDateTime::currentMSecsSinceEpoch();
+    QMetaObject::invokeMethod(this, "onAnnounceTip", Qt::QueuedConnection);
+}
+
+
+/**
+ * @brief Reassembles the bytes read from the peer into messages and handles each complete one.
+ */
+void Blockchain::readFrames(QTcpSocket *peer)
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto data = peer->readAll();
+    bytesReceived->add(data.size());
+    peers[peer].reader.append(data);
+    FrameReader::Frame frame;
+    while (!peers[peer].closing && peers[peer].reader.next(frame))
+        handleMessage(peer, frame);
+    if (peers[peer].reader.hasError())
+        disconnectPeer(peer, "Invalid stream from");
+    networkTime += timer.nsecsElapsed();
+}
+
+
+/**
+ * @brief Writes a message to the peer. A peer whose write buffer went over
+ * PEER_WRITE_HIGH_WATERMARK lags: until the buffer drains below
+ * PEER_WRITE_LOW_WATERMARK its tips and ledgers are held back, a newer one
+ * superseding the one held. A peer that lags for PEER_LAG_TIMEOUT or whose
+ * buffer would go over PEER_WRITE_BUDGET is disconnected.
+ */
+void Blockchain::send(QTcpSocket *peer, Protocol::MessageType type, const QByteArray &message)
+{
+    auto state = peers.find(peer);
+    if (state == peers.end() || state->closing)
+        return;
+    auto now = QDateTime::currentMSecsSinceEpoch();
+    if (state->lagging) {
+        if (now - state->laggingSince > PEER_LAG_TIMEOUT) {
+            disconnectPeer(peer, "Write queue stalled for");
+            return;
+        }
+        // Relayed transactions are best effort, a lagging peer goes without
+        if (type == Protocol::Transactions) {
+            state->dropped++;
+            return;
+        }
+        if (type == Protocol::Tip || type == Protocol::Ledger) {
+            auto &pending = type == Protocol::Tip ? state->tipPending : state->ledgerPending;
+            if (pending)
+                state->dropped++;
+            pending = true;
+            return;
+        }
+    }
+    if (peer->bytesToWrite() + message.size() > PEER_WRITE_BUDGET) {
+        disconnectPeer(peer, "Write queue over budget for");
+        return;
+    }
+    peer->write(message);
+    bytesSent->add(message.size());
+    if (!state->lagging && peer->bytesToWrite() > PEER_WRITE_HIGH_WATERMARK) {
+        state->lagging = true;
+        state->laggingSince = now;
+    }
+}
+
+
+/**
+ * @brief Changes the health score of the peer, it is disconnected once the score drops to 0.
+ */
+void Blockchain::adjustScore(QTcpSocket *peer, int delta, const QString &reason)
+{
+    auto state = peers.find(peer);
+    if (state == peers.end())
+        return;
+    state->score = std::min(state->score + delta, PEER_MAX_SCORE);
+    if (state->score > 0)
+        return;
+    disconnectPeer(peer, reason + " from");
+}
+
+
+/**
+ * @brief Closes the connection once control is back in the event loop, so the
+ * peer's state stays valid for the caller.
+ */
+void Blockchain::disconnectPeer(QTcpSocket *peer, const QString &reason)
+{
+    auto state = peers.find(peer);
+    if (state == peers.end() || state->closing)
+        return;
+    state->closing = true;
+    emit messageSent(reason + " " + peerName(peer) + ", disconnecting!", Qt::red);
+    QMetaObject::invokeMethod(peer, [peer]() {
+        peer->abort();
+    }, Qt::QueuedConnection);
+}
+
+
+/**
+ * @brief Connection and write queue state of every peer, for monitoring.
+ */
+QVector<Blockchain::PeerStats> Blockchain::getPeerStats() const
+{
+    QVector<PeerStats> stats;
+    for (auto it = peers.cbegin(); it != peers.cend(); ++it) {
+        PeerStats peer;
+        peer.address = peerName(it.key());
+        peer.outbound = it->outbound;
+        peer.legacy = it->legacy;
+        peer.score = it->score;
+        peer.queuedBytes = it.key()->bytesToWrite();
+        peer.lagging = it->lagging;
+        peer.dropped = it->dropped;
+        stats.push_back(peer);
+    }
+    return stats;
+}
+
+
+/**
+ * @brief Bytes written to all peers and not sent yet.
+ */
+qint64 Blockchain::getQueuedBytes() const
+{
+    qint64 total = 0;
+    for (auto it = peers.cbegin(); it != peers.cend(); ++it)
+        total += it.key()->bytesToWrite();
+    return total;
+}
+
+
+QString Blockchain::peerName(QTcpSocket *peer)
+{
+    return peer->peerAddress().toString() + ":" + QString::number(peer->peerPort());
+}
+
+
+/**
+ * @return The id of the connection, 0 for an unknown socket
+ */
+quint64 Blockchain::peerId(QTcpSocket *peer) const
+{
+    auto state = peers.constFind(peer);
+    return state == peers.cend() ? 0 : state->id;
+}
+
+
+/**
+ * @return The socket of the connection, nullptr once it is closed
+ */
+QTcpSocket *Blockchain::findPeer(quint64 id) const
+{
+    for (auto it = peers.cbegin(); it != peers.cend(); ++it) {
+        if (it->id == id)
+            return it.key();
+    }
+    return nullptr;
+}
+
+
+void Blockchain::handleMessage(QTcpSocket *peer, const FrameReader::Frame &frame)
+{
+    switch (frame.type) {
+    case Protocol::Ledger: {
+        // Old protocol, keep exchanging full ledgers with this peer
+        peers[peer].legacy = true;
+        QVector<Block> blocks;
+        if (parseLedgerJson(frame.payload, blocks))
+            validateBatch(peer, blocks);
+        else
+            adjustScore(peer, -PEER_MALFORMED_PENALTY, "Malformed ledger");
+        if (peers[peer].outbound)
+            send(peer, Protocol::Ledger, getLedgerJson());
+        break;
+    }
+    case Protocol::Tip: {
+        Protocol::TipInfo tip;
+        if (Protocol::decodeTip(frame.payload, tip))
+            onTip(peer, tip);
+        else
+            adjustScore(peer, -PEER_MALFORMED_PENALTY, "Malformed tip");
+        break;
+    }
+    case Protocol::GetBlocks: {
+        QVector<QByteArray> locator;
+        if (Protocol::decodeGetBlocks(frame.payload, locator))
+            send(peer, Protocol::Blocks, Protocol::encodeBlocks(blocksAfter(locator)));
+        else
+            adjustScore(peer, -PEER_MALFORMED_PENALTY, "Malformed request");
+        break;
+    }
+    case Protocol::Blocks: {
+        QVector<Block> blocks;
+        if (Protocol::decodeBlocks(frame.payload, blocks))
+            onBlocks(peer, blocks);
+        else
+            adjustScore(peer, -PEER_MALFORMED_PENALTY, "Malformed blocks");
+        break;
+    }
+    case Protocol::GetProof: {
+        QByteArray blockHash, transactionHash;
+        Protocol::InclusionProof proof;
+        if (!Protocol::decodeGetProof(frame.payload, blockHash, transactionHash))
+            adjustScore(peer, -PEER_MALFORMED_PENALTY, "Malformed proof request");
+        else if (getProof(blockHash, transactionHash, proof))
+            send(peer, Protocol::Proof, Protocol::encodeProof(proof));
+        else
+            send(peer, Protocol::Proof, Protocol::encodeProof(Protocol::InclusionProof()));
+        break;
+    }
+    case Protocol::Transactions: {
+        QVector<Transaction> transactions;
+        if (Protocol::decodeTransactions(frame.payload, transactions)) {
+            for (const auto &transaction : transactions)
+                acceptTransaction(peer, transaction);
+        } else {
+            adjustScore(peer, -PEER_MALFORMED_PENALTY, "Malformed transactions");
+        }
+        break;
+    }
+    default:
+        adjustScore(peer, -PEER_MALFORMED_PENALTY, "Unknown message");
+        break;
+    }
+}
+
+
+void Blockchain::onTip(QTcpSocket *peer, const Protocol::TipInfo &tip)
+{
+    auto &state = peers[peer];
+    state.tip = tip;
+    // Answer the server's announcement with our own tip
+    if (state.outbound)
+        send(peer, Protocol::Tip, Protocol::encodeTip(getTip()));
+    auto now = QDateTime::currentMSecsSinceEpoch();
+    // A request or its answer may have been lost, then it is sent again
+    if ((!state.requested || now - state.requestedAt > BLOCK_REQUEST_TIMEOUT) && tip.work > getLedger()->getWork()) {
+        send(peer, Protocol::GetBlocks, Protocol::encodeGetBlocks(getLocator(*getLedger())));
+        state.requested = true;
+        state.requestedAt = now;
+    }
+}
+
+
+/**
+ * @brief Hands received blocks to the validation pipeline. If the batch was
+ * full the next one is requested right away, so it downloads while this one
+ * is validated.
+ */
+void Blockchain::onBlocks(QTcpSocket *peer, const QVector<Block> &blocks)
+{
+    auto &state = peers[peer];
+    state.requested = false;
+    if (blocks.isEmpty())
+        return;
+    if (blocks.size() == MAX_BLOCKS_PER_MESSAGE) {
+        // Continue after the last block received, it may still be on a side branch
+        QVector<QByteArray> locator {blocks.back().getHash()};
+        locator.append(getLocator(*getLedger()));
+        send(peer, Protocol::GetBlocks, Protocol::encodeGetBlocks(locator));
+        state.requested = true;
+        state.requestedAt = QDateTime::currentMSecsSinceEpoch();
+    }
+    validateBatch(peer, blocks);
+}
+
+
+/**
+ * @brief Adds a transaction of our own to the mempool and relays it to the
+ * peers. Called on the event loop thread.
+ * @return False if the mempool did not take it
+ */
+bool Blockchain::submitTransaction(const Transaction &transaction)
+{
+    return acceptTransaction(nullptr, transaction);
+}
+
+
+/**
+ * @brief Adds the transaction to the mempool and queues it for relaying, the
+ * queue goes out TX_RELAY_INTERVAL after its first transaction.
+ */
+bool Blockchain::acceptTransaction(QTcpSocket *source, const Transaction &transaction)
+{
+    if (!mempool.add(transaction))
+        return false;
+    transactionsReceived->add();
+    relayQueue.append({source ? peerId(source) : 0, transaction});
+    if (!relayTimer.isActive())
+        relayTimer.start();
+    return true;
+}
+
+
+/**
+ * @brief Sends the queued transactions to every peer but the one each came
+ * from, in messages of up to TX_RELAY_MAX_BYTES.
+ */
+void Blockchain::onRelayTransactions()
+{
+    QElapsedTimer timer;
+    timer.start();
+    auto queue = std::exchange(relayQueue, {});
+    for (auto it = peers.cbegin(); it != peers.cend(); ++it) {
+        if (it->legacy || it->closing)
+            continue;
+        QVector<Transaction> batch;
+        qint64 bytes = 0;
+        for (const auto &relay : queue) {
+            if (relay.first == it->id)
+                continue;
+            batch.push_back(relay.second);
+            bytes += relay.second.getSize();
+            if (bytes >= TX_RELAY_MAX_BYTES) {
+                send(it.key(), Protocol::Transactions, Protocol::encodeTransactions(batch));
+                batch.clear();
+                bytes = 0;
+            }
+        }
+        if (!batch.isEmpty())
+            send(it.key(), Protocol::Transactions, Protocol::encodeTransactions(batch));
+    }
+    networkTime += timer.nsecsElapsed();
+}
+
+
+/**
+ * @brief Builds the proof that the transaction is in the block, the block may
+ * be on a side branch.
+ * @return False if the block is unknown, older than MerkleVersion, or does not hold the transaction
+ */
+bool Blockchain::getProof(const QByteArray &blockHash, const QByteArray &transactionHash, Protocol::InclusionProof &proof)
+{
+    Block block;
+    {
+        // Not publishMutex, which is held while a whole batch is published
+        QMutexLocker locker(&treeMutex);
+        auto node = tree.find(blockHash);
+        if (!node || node->header.version < Block::MerkleVersion)
+            return false;
+        // Pruned blocks are on the ledger, which holds their payload. It is
+        // loaded under treeMutex since blocks get their payload back before
+        // they leave the published ledger
+        block = Block(node->header, node->pruned ? getLedger()->payload(node->header.index) : node->payload);
+    }
+    auto hashes = Transaction::getHashes(blockTransactions(block.getData()));
+    auto position = hashes.indexOf(transactionHash);
+    if (position < 0)
+        return false;
+    proof.header.resize(Block::HeaderSize);
+    block.writeHeader(reinterpret_cast<uchar *>(proof.header.data()));
+    proof.transaction = transactionHash;
+    proof.position = position;
+    proof.count = hashes.size();
+    proof.path = MerkleTree::proof(hashes, position);
+    return true;
+}
+
+
+/**
+ * @brief Transactions in a block payload, none for payloads that are not a
+ * transaction list, like the ones of blocks mined before the mempool.
+ */
+QVector<Transaction> Blockchain::blockTransactions(const QByteArray &payload)
+{
+    QVector<Transaction> transactions;
+    if (!Transaction::deserializeList(payload, transactions))
+        transactions.clear();
+    return transactions;
+}
+
+
+void Blockchain::onBatchValidated(quint64 peerId, bool valid)
+{
+    // The peer may have disconnected while its blocks were validated
+    auto *peer = findPeer(peerId);
+    if (!peer)
+        return;
+    if (valid)
+        adjustScore(peer, PEER_VALID_BLOCKS_REWARD);
+    else
+        adjustScore(peer, -PEER_INVALID_BLOCKS_PENALTY, "Invalid blocks");
+}
+
+
+Protocol::TipInfo Blockchain::getTip()
+{
+    auto ledger = getLedger();
+    Protocol::TipInfo tip;
+    if (!ledger->isEmpty()) {
+        tip.height = ledger->back().index;
+        tip.hash = ledger->back().getHash();
+    }
+    tip.work = ledger->getWork();
+    return tip;
+}
+
+
+/**
+ * @brief Hashes of the last 10 blocks, then exponentially sparser back to genesis.
+ */
+QVector<QByteArray> Blockchain::getLocator(const Ledger &chain) const
+{
+    QVector<QByteArray> locator;
+    qint64 step = 1;
+    qint64 i = chain.size() - 1;
+    for (; i > 0; i -= step) {
+        locator.push_back(chain.header(i).getHash());
+        if (locator.size() >= 10)
+            step *= 2;
+    }
+    if (!chain.isEmpty())
+        locator.push_back(chain.front().getHash());
+    return locator;
+}
+
+
+/**
+ * @brief Blocks after the first locator hash found in our ledger, from genesis if none is found.
+ */
+QVector<Block> Blockchain::blocksAfter(const QVector<QByteArray> &locator) const
+{
+    auto ledger = getLedger();
+    qint64 start = 0;
+    QReadLocker locker(&indexLock);
+    for (const auto &hash : locator) {
+        // The index may already have moved to a newer chain than the snapshot
+        auto height = chainIndex.find(hash);
+        if (height >= 0 && height < ledger->size() && ledger->header(height).isHash(hash)) {
+            start = height + 1;
+            break;
+        }
+    }
+    locker.unlock();
+    return ledger->blocks(start, MAX_BLOCKS_PER_MESSAGE);
 }
 
 
@@ -143,7 +657,10 @@ void Blockchain::startMining()
     int maxCounter = 0;
     emit messageSent("Ledger started!", QColor(Qt::green));
     QColor color;
+    stopping = false;
     while (true) {
+        if (stopping)
+            break;
         if (updated) {
             color = Qt::gray;
             updated = false;
@@ -152,18 +669,13 @@ void Blockchain::startMining()
         }
         if (maxCounter == MAX_CHAIN_LENGTH)
             break;
-        if (ledger.size() == 0) {
-            emit difficultyChanged(DEFAULT_DIFF);
-            block = mine(*(new Block(-1, "Block -1", QByteArray('\0', 32), DEFAULT_DIFF)));
-            if (updated)
-                continue;
-            addBlock(block);
-            emit blockMined(block, color);
-        } else {
-            block = mine(ledger.back());
-            if (updated)
-                continue;
-            addBlock(block);
+        // The network thread may replace the ledger meanwhile, then updated is set
+        auto ledger = getLedger();
+        block = mine(*ledger);
+        if (updated)
+            continue;
+        if (addBlock(block)) {
+            blocksMined->add();
             emit blockMined(block, color);
         }
         maxCounter++;
@@ -174,93 +686,94 @@ void Blockchain::startMining()
 }
 
 
-Block Blockchain::mine(const Block &prevBlock)
+/**
+ * @brief Makes startMining() return, an ongoing nonce search is aborted.
+ */
+void Blockchain::stopMining()
 {
-    Block *block;
-    auto timeExpected = BLOCK_GENERATION_INTERVAL * DIFF_ADJUST_INTERVAL;
-    if (prevBlock.getIndex() == -1) {
-        block = new Block(0, "First block", QByteArray(), DEFAULT_DIFF);
-    } else {
-        block = new Block(prevBlock.getIndex() + 1, "Block " + QByteArray::number(prevBlock.getIndex() + 1), prevBlock.getHash(), DEFAULT_DIFF);
-    }
-    block->setDifficulty(prevBlock.getDifficulty());
-    qint64 timeTaken = 0;
-    Block *prevAdjBlock {nullptr};
-    if (ledger.size() >= DIFF_ADJUST_INTERVAL) {
-        prevAdjBlock = &ledger[ledger.size() - DIFF_ADJUST_INTERVAL];
-    }
-    block->setTimestamp(QDateTime::currentMSecsSinceEpoch());
-    while (true) {
-        if (updated)
-            break;
-        auto hash = nextHash(*block);
-        // Adjust difficulty
-        if (prevAdjBlock) {
-            auto timeTaken = block->getTimestamp() - prevAdjBlock->getTimestamp();
-            if (timeTaken < (timeExpected / 2)) {
-                block->setDifficulty(block->getDifficulty() + 1);
-                prevAdjBlock = nullptr;
-                emit difficultyChanged(block->getDifficulty());
-            } else if (timeTaken > (timeExpected * 2)) {
-                block->setDifficulty(block->getDifficulty() - 1);
-                prevAdjBlock = nullptr;
-                emit difficultyChanged(block->getDifficulty());
-            }
-        }
-        auto hashDiff = Block::getHashDiff(hash);
-        if (hashDiff >= block->getDifficulty()) {
-            // TODO: Change according to global value
-            block->setHash(hash);
-            return std::move(*block);
-        }
-    }
-    if (prevAdjBlock)
-        delete prevAdjBlock;
-    return {};
+    stopping = true;
+    updated = true;
 }
 
 
-void Blockchain::addBlock(Block block)
+/**
+ * @brief Mines a block on top of the given snapshot.
+ */
+Block Blockchain::mine(const Ledger &ledger)
 {
-    if (isBlockValid(block)) {
-        ledger.push_back(block);
-        qint64 totalTime = (QDateTime::currentMSecsSinceEpoch() - ledger[0].getTimestamp()) / ledger.size();
-        emit updateAverage(totalTime);
-        qint64 past10Index = std::max(0, (int)ledger.size() - 10);
-        qint64 time10 = (QDateTime::currentMSecsSinceEpoch() - ledger[past10Index].getTimestamp()) / (ledger.size() - past10Index);
-        emit update10Average(time10);
-    } else {
+    Block block;
+    // The template is fixed for the whole nonce search, later transactions wait for the next block
+    auto payload = Transaction::serializeList(mempool.assemble(BLOCK_MAX_PAYLOAD));
+    if (ledger.isEmpty())
+        block = Block(0, payload, QByteArray(), 0);
+    else
+        block = Block(ledger.back().index + 1, payload, ledger.back().getHash(), 0);
+    block.setTimestamp(QDateTime::currentMSecsSinceEpoch());
+    // Retarget once per template, the timestamp is fixed for the whole nonce search
+    auto policy = std::atomic_load(&difficultyPolicy);
+    auto steps = policy->nextDifficulty(ledger, block.getTimestamp());
+    block.setDifficultySteps(steps);
+    if (miningDifficulty.exchange(steps) != steps)
+        emit difficultyChanged(steps);
+    if (!miner.mine(block))
+        return {};
+    return block;
+}
+
+
+/**
+ * @brief Adds the mined block to the tree and publishes it as the new tip.
+ * @return False if the block is invalid or the ledger was replaced while mining
+ */
+bool Blockchain::addBlock(const Block &block)
+{
+    QMutexLocker locker(&publishMutex);
+    if (connectBlock(block) == Invalid) {
+        locker.unlock();
         emit messageSent("Invalid block:\n" + block.toQString(), QColor(Qt::red));
+        return false;
     }
+    // Mined on a tip that was replaced meanwhile, the block stays on a side branch
+    if (!publishBestChain(false))
+        return false;
+    auto next = getLedger();
+    locker.unlock();
+    qint64 totalTime = (QDateTime::currentMSecsSinceEpoch() - next->front().timestamp) / next->size();
+    emit updateAverage(totalTime);
+    qint64 past10Index = std::max<qint64>(0, next->size() - 10);
+    qint64 time10 = (QDateTime::currentMSecsSinceEpoch() - next->header(past10Index).timestamp) / (next->size() - past10Index);
+    emit update10Average(time10);
+    return true;
 }
 
 
+/**
+ * @brief Validates a genesis block, later blocks are validated against their predecessor.
+ */
 bool Blockchain::isBlockValid(const Block &block) const
 {
-    if (block.getHash() != block.calculateHash())
+    if (block.getIndex() != 0)
+        return false;
+    if (!isHashValid(block))
         return false;
     if (block.getTimestamp() > QDateTime::currentMSecsSinceEpoch() + TIMESTAMP_LENGTH)
         return false;
-    if (block.getIndex() != 0) {
-        auto &prevBlock = ledger.back();
-        if (prevBlock.getHash() != block.getPrevHash())
-            return false;
-        if (block.getTimestamp() < prevBlock.getTimestamp() - TIMESTAMP_LENGTH)
-            return false;
-    }
     return true;
 }
 
 
-bool Blockchain::isBlockValid(const Block &prevBlock, const Block &block)
+/**
+ * @brief Checks the link to the previous block and the timestamp, the hash is checked separately.
+ */
+bool Blockchain::isHeaderValid(const BlockHeader &prev, const BlockHeader &header) const
 {
-    if (block.getPrevHash() != prevBlock.getHash())
+    if (!header.follows(prev))
         return false;
-    if (block.calculateHash() != block.getHash())
+    if (header.index != prev.index + 1)
         return false;
-    if (block.getTimestamp() > QDateTime::currentMSecsSinceEpoch() + TIMESTAMP_LENGTH)
+    if (header.timestamp > QDateTime::currentMSecsSinceEpoch() + TIMESTAMP_LENGTH)
         return false;
-    if (block.getTimestamp() < prevBlock.getTimestamp() - TIMESTAMP_LENGTH)
+    if (header.timestamp < prev.timestamp - TIMESTAMP_LENGTH)
         return false;
     return true;
 }
@@ -268,16 +781,7 @@ bool Blockchain::isBlockValid(const Block &prevBlock, const Block &block)
 
 bool Blockchain::validateLedger() const
 {
-    if (ledger.size() == 0)
-        return false;
-    if (ledger.size() == 1)
-        if (!isBlockValid(ledger.back()))
-            return false;
-    for (int i = 0; i < ledger.size() - 1; i++) {
-        if (!isBlockValid(ledger[i], ledger[i + 1]))
-            return false;
-    }
-    return true;
+    return validateLedger(*getLedger());
 }
 
 
@@ -288,109 +792,454 @@ bool Blockchain::validateLedgerIntegrity() const
 }
 
 
-bool Blockchain::validateLedger(const QVector<Block> &ledger)
+/**
+ * @brief Validates the ledger from the given index on. Blocks before it are assumed valid.
+ * The links are checked on the headers first, payloads are only read to verify the hashes.
+ * @param from First block to validate
+ * @return True if the ledger is valid
+ */
+bool Blockchain::validateLedger(const Ledger &ledger, qint64 from) const
 {
     if (ledger.size() == 0)
         return false;
-    if (ledger.size() == 1)
-        if (!isBlockValid(ledger.back()))
-            return false;
-    for (int i = 0; i < ledger.size() - 1; i++) {
-        if (!isBlockValid(ledger[i], ledger[i + 1]))
+    if (from == 0 && !isBlockValid(ledger.block(0)))
+        return false;
+    for (qint64 i = std::max<qint64>(from, 1); i < ledger.size(); i++) {
+        if (!isHeaderValid(ledger.header(i - 1), ledger.header(i)))
             return false;
     }
+    auto blocks = ledger.blocks(std::max<qint64>(from, 1));
+    return verifyHashes(blocks) == blocks.size();
+}
+
+
+/**
+ * @brief Checks the block hash, blocks verified before are only compared against the cache.
+ */
+bool Blockchain::isHashValid(const Block &block) const
+{
+    QMutexLocker locker(&verifiedMutex);
+    auto cached = verifiedBlocks.constFind(block.getHash());
+    if (cached != verifiedBlocks.constEnd())
+        return *cached == block;
+    locker.unlock();
+    if (!block.verifyHash())
+        return false;
+    locker.relock();
+    if (verifiedBlocks.size() >= VERIFIED_CACHE_SIZE)
+        verifiedBlocks.clear();
+    verifiedBlocks.insert(block.getHash(), block);
     return true;
 }
 
 
+/**
+ * @brief Current ledger snapshot, it stays valid and unchanged while it is held.
+ * Loading takes a short lock inside the standard library, not publishMutex.
+ */
+LedgerSnapshot Blockchain::getLedger() const
+{
+    return std::atomic_load(&ledger);
+}
+
+
 QByteArray Blockchain::getLedgerJson() const
 {
+    auto ledger = getLedger();
     QJsonObject jsonObject;
-    for (const auto &block: ledger) {
-        QJsonObject _block;
-        _block.insert("index", block.getIndex());
-        _block.insert("timestamp", block.getTimestamp());
-        _block.insert("data", QJsonValue::fromVariant(QVariant::fromValue(block.getData().toBase64())));
-        _block.insert("hash", QJsonValue::fromVariant(QVariant::fromValue(block.getHash().toBase64())));
-        _block.insert("prevHash", QJsonValue::fromVariant(QVariant::fromValue(block.getPrevHash().toBase64())));
-        _block.insert("nonce", block.getNonce());
-        _block.insert("difficulty", block.getDifficulty());
-        jsonObject.insert(QStringLiteral("%1").arg(block.getIndex(), 10, 10, QLatin1Char('0')), _block);
-    }
+    for (qint64 i = 0; i < ledger->size(); i++)
+        jsonObject.insert(QStringLiteral("%1").arg(ledger->header(i).index, 10, 10, QLatin1Char('0')), ledger->block(i).toJson());
     QJsonDocument doc;
     doc.setObject(jsonObject);
     return doc.toJson();
 }
 
 
-void Blockchain::updateLedgerFromJson(QByteArray json)
+/**
+ * @brief Reads a ledger sent as JSON, its blocks must form a chain from genesis in any key order.
+ */
+bool Blockchain::parseLedgerJson(const QByteArray &json, QVector<Block> &blocks)
 {
     auto doc = QJsonDocument::fromJson(json);
     if (doc.isNull())
-        return;
+        return false;
     if (doc.isEmpty())
-        return;
+        return false;
     auto jsonObject = doc.object();
-    qint64 i = 0;
+    for (auto item : jsonObject)
+        blocks.push_back(Block::fromJson(item.toObject()));
+    // Keys only need to be unique, the order comes from the block indexes
+    std::sort(blocks.begin(), blocks.end(), [](const Block &a, const Block &b) {
+        return a.getIndex() < b.getIndex();
+    });
+    for (qint64 i = 0; i < blocks.size(); i++) {
+        if (blocks[i].getIndex() != i)
+            return false;
+    }
+    return true;
+}
+
+
+void Blockchain::updateLedgerFromJson(QByteArray json)
+{
     QVector<Block> newLedger;
-    for (auto item : jsonObject) {
-        auto _block = item.toObject();
-        auto index = _block.value("index").toInteger();
-        if (index != i)
-            return;
-        auto timestamp = _block.value("timestamp").toInteger();
-        auto data = QByteArray::fromBase64(_block.value("data").toVariant().value<QByteArray>());
-        auto hash = QByteArray::fromBase64(_block.value("hash").toVariant().value<QByteArray>());
-        auto prevHash = QByteArray::fromBase64(_block.value("prevHash").toVariant().value<QByteArray>());
-        auto nonce = _block.value("nonce").toInteger();
-        auto difficulty = _block.value("difficulty").toInteger();
-        newLedger.push_back({index, timestamp, data, hash, prevHash, nonce, (qint8)difficulty});
-        i++;
-    }
-    auto valid = validateLedger(newLedger);
-    if (!valid)
+    if (!parseLedgerJson(json, newLedger))
         return;
-    auto cumulativeDiff = cumulativeDifficulty();
-    auto newCumulativeDiff = cumulativeDifficulty(newLedger);
-    if (newCumulativeDiff > cumulativeDiff) {
-        ledger = newLedger;
+    validateBlocks(newLedger);
+    // emit messageSent("Starting with the new ledger!", QColor(Qt::black));
+}
+
+
+/**
+ * @brief Queues received blocks for validateBlocks() on the validation thread,
+ * batchValidated() reports the result back to the event loop.
+ */
+void Blockchain::validateBatch(QTcpSocket *peer, const QVector<Block> &blocks)
+{
+    auto id = peerId(peer);
+    validationPool.start([this, id, blocks]() {
+        QElapsedTimer timer;
+        timer.start();
+        auto valid = validateBlocks(blocks);
+        validationTime->observe(timer.nsecsElapsed() / 1e9);
+        emit batchValidated(id, valid);
+    });
+}
+
+
+/**
+ * @brief Validates blocks received from a peer and adds them to the tree.
+ * Blocks already in the tree are skipped, the hashes of the others are checked
+ * in parallel, then they are linked to their parents one by one.
+ * @return False if one of the blocks is invalid, the blocks after it are ignored
+ */
+bool Blockchain::validateBlocks(const QVector<Block> &blocks)
+{
+    QVector<Block> fresh;
+    {
+        QMutexLocker locker(&publishMutex);
+        for (const auto &block : blocks) {
+            if (!tree.contains(block.getHash()))
+                fresh.push_back(block);
+        }
+    }
+    auto verified = verifyHashes(fresh);
+    // Counted per block like connectBlock does, the ones after the bad hash are not accepted either
+    if (verified < fresh.size())
+        blocksRejected->add(fresh.size() - verified);
+    auto valid = acceptBlocks(fresh.mid(0, verified), true);
+    return valid && verified == fresh.size();
+}
+
+
+/**
+ * @brief Checks the hash and proof of work of every block, spread over the global thread pool.
+ * @return Number of blocks before the first invalid one
+ */
+qsizetype Blockchain::verifyHashes(const QVector<Block> &blocks) const
+{
+    auto pool = QThreadPool::globalInstance();
+    auto threads = std::max(1, pool->maxThreadCount());
+    auto chunk = std::max<qsizetype>(MIN_VALIDATION_CHUNK, (blocks.size() + threads - 1) / threads);
+    std::atomic<qsizetype> firstInvalid {blocks.size()};
+    auto verify = [&blocks, &firstInvalid](qsizetype begin, qsizetype end) {
+        // Ranges after an invalid block found elsewhere are not needed
+        for (auto i = begin; i < end && i < firstInvalid; i++) {
+            if (!blocks[i].verifyHash()) {
+                auto current = firstInvalid.load();
+                while (i < current && !firstInvalid.compare_exchange_weak(current, i)) {}
+                return;
+            }
+        }
+    };
+    QSemaphore done;
+    int tasks = 0;
+    for (auto begin = chunk; begin < blocks.size(); begin += chunk) {
+        auto end = std::min(begin + chunk, blocks.size());
+        pool->start([&verify, &done, begin, end]() {
+            verify(begin, end);
+            done.release();
+        });
+        tasks++;
+    }
+    // This thread takes the first range
+    verify(0, std::min(chunk, blocks.size()));
+    done.acquire(tasks);
+    return firstInvalid;
+}
+
+
+/**
+ * @brief Adds blocks to the tree and switches to the best branch.
+ * @param hashesChecked The hashes of the given blocks were verified already
+ * @return False if one of the blocks is invalid, the blocks after it are ignored
+ */
+bool Blockchain::acceptBlocks(const QVector<Block> &blocks, bool hashesChecked)
+{
+    QMutexLocker locker(&publishMutex);
+    auto valid = true;
+    for (const auto &block : blocks) {
+        if (connectBlock(block, hashesChecked) == Invalid) {
+            valid = false;
+            break;
+        }
+    }
+    publishBestChain(true);
+    return valid;
+}
+
+
+/**
+ * @brief Validates the block against its parent and adds it to the tree,
+ * followed by the orphans that were waiting for it. A block whose parent is
+ * unknown goes to the orphan pool. The caller holds publishMutex.
+ * @param hashChecked The hash of the block was verified already, not the ones of its orphans
+ */
+Blockchain::ConnectResult Blockchain::connectBlock(const Block &block, bool hashChecked)
+{
+    if (tree.contains(block.getHash()))
+        return Known;
+    if (block.getIndex() != 0 && !tree.contains(block.getPrevHash())) {
+        QMutexLocker treeLocker(&treeMutex);
+        tree.addOrphan(block);
+        return Orphan;
+    }
+    QVector<Block> queue {block};
+    for (qsizetype i = 0; i < queue.size(); i++) {
+        const auto next = queue[i];
+        bool valid;
+        if (next.getIndex() == 0) {
+            valid = isBlockValid(next);
+        } else {
+            BlockHeader header;
+            auto parent = tree.find(next.getPrevHash());
+            valid = next.getHeader(header) && isHeaderValid(parent->header, header)
+                    && ((i == 0 && hashChecked) || isHashValid(next));
+        }
+        QMutexLocker treeLocker(&treeMutex);
+        if (!valid || !tree.insert(next)) {
+            treeLocker.unlock();
+            blocksRejected->add();
+            if (i == 0)
+                return Invalid;
+            continue;
+        }
+        queue.append(tree.takeOrphans(next.getHash()));
+        treeLocker.unlock();
+        blocksAccepted->add();
+    }
+    return Connected;
+}
+
+
+/**
+ * @brief Switches the ledger to the best branch of the tree. Only the blocks
+ * after the fork point are read from the tree and written to the store, the
+ * common part is shared with the current snapshot. The caller holds publishMutex.
+ * @param restartMiner Tells the miner to drop its work on the old tip
+ * @return True if the tip changed
+ */
+bool Blockchain::publishBestChain(bool restartMiner)
+{
+    auto current = getLedger();
+    auto hash = tree.getBest();
+    if (hash.isEmpty() || (!current->isEmpty() && current->back().isHash(hash)))
+        return false;
+    // Walk back from the best tip to the first block on our ledger
+    QVector<const BlockTree::Node *> branch;
+    qint64 fork = 0;
+    while (!hash.isEmpty()) {
+        auto node = tree.find(hash);
+        auto height = node->header.index;
+        if (height < current->size() && current->header(height).isHash(hash)) {
+            fork = height + 1;
+            break;
+        }
+        branch.push_back(node);
+        hash = node->header.getPrevHash();
+    }
+    reorgDepth->observe(current->size() - fork);
+    // Transactions of the replaced blocks are pending again, the ones of the new blocks are not.
+    // The replaced blocks become a side branch, which needs its payloads back
+    for (qint64 i = fork; i < current->size(); i++) {
+        mempool.unconfirm(blockTransactions(current->payload(i)));
+        QMutexLocker treeLocker(&treeMutex);
+        tree.restore(current->header(i).getHash(), current->payload(i));
+    }
+    auto next = std::make_shared<Ledger>(current->prefix(fork));
+    for (auto it = branch.crbegin(); it != branch.crend(); ++it) {
+        next->append(Block((*it)->header, (*it)->payload));
+        auto transactions = blockTransactions((*it)->payload);
+        transactionsConfirmed->add(transactions.size());
+        mempool.confirm(transactions);
+    }
+    updateIndex(*current, *next, fork);
+    std::atomic_store(&ledger, LedgerSnapshot(next));
+    {
+        QMutexLocker treeLocker(&treeMutex);
+        tree.prune(next->size() - BLOCK_PRUNE_DEPTH, STALE_BRANCH_AGE);
+    }
+    if (restartMiner)
         updated = true;
-        // emit messageSent("Starting with the new ledger!", QColor(Qt::black));
+    requestAnnouncement();
+    if (store.isOpen()) {
+        store.truncate(fork);
+        for (qint64 i = fork; i < next->size(); i++)
+            store.append(next->block(i));
     }
+    return true;
 }
 
 
 /**
- * @brief Calculates the cumulative ledger difficulty. Assumes the ledger is valid.
- * @return Cumulative difficulty
+ * @brief Moves the chain index from the previous best chain to the next one,
+ * which share the blocks below the fork height. The caller holds publishMutex.
  */
-qint64 Blockchain::cumulativeDifficulty()
+void Blockchain::updateIndex(const Ledger &previous, const Ledger &next, qint64 fork)
 {
-    qint64 sum = 0;
-    for (const auto &block : ledger) {
-        sum += std::pow(2, block.getDifficulty());
+    QWriteLocker locker(&indexLock);
+    if (fork == 0) {
+        chainIndex.clear();
+        chainIndex.reserve(next.size());
+    } else {
+        for (qint64 i = fork; i < previous.size(); i++)
+            chainIndex.remove(previous.header(i).hash);
     }
-    return sum;
+    for (qint64 i = fork; i < next.size(); i++)
+        chainIndex.insert(next.header(i).hash, i);
 }
 
 
 /**
- * @brief Calculates the cumulative ledger difficulty. Assumes the ledger is valid.
- * @return Cumulative difficulty
+ * @brief Opens the block store in the given directory and resumes from the stored ledger.
+ * The store only ever holds validated blocks, so they are not validated again.
  */
-qint64 Blockchain::cumulativeDifficulty(QVector<Block> &ledger)
+bool Blockchain::openStore(const QString &directory)
 {
-    qint64 sum = 0;
-    for (const auto &block : ledger) {
-        sum += std::pow(2, block.getDifficulty());
+    if (!store.open(directory)) {
+        emit messageSent("Could not open the block store in " + directory, Qt::red);
+        return false;
+    }
+    auto blocks = store.readAll();
+    auto stored = std::make_shared<const Ledger>(blocks);
+    QMutexLocker locker(&publishMutex);
+    QMutexLocker treeLocker(&treeMutex);
+    // Already validated, so they go into the tree as they are
+    for (const auto &block : blocks) {
+        if (!tree.contains(block.getHash()) && !tree.insert(block))
+            break;
+    }
+    auto current = getLedger();
+    if (stored->getWork() > current->getWork()) {
+        // Rebuilt from the stored chain, not kept on disk
+        for (qint64 i = 0; i < current->size(); i++)
+            tree.restore(current->header(i).getHash(), current->payload(i));
+        updateIndex(*current, *stored, 0);
+        std::atomic_store(&ledger, stored);
+        tree.prune(stored->size() - BLOCK_PRUNE_DEPTH, STALE_BRANCH_AGE);
+        treeLocker.unlock();
+        updated = true;
+        requestAnnouncement();
+        locker.unlock();
+        emit messageSent("Loaded " + QString::number(stored->size()) + " blocks from " + directory, Qt::gray);
+    } else {
+        treeLocker.unlock();
+        // Ours has at least as much work, store it instead
+        store.truncate(0);
+        for (qint64 i = 0; i < current->size(); i++)
+            store.append(current->block(i));
     }
-    return sum;
+    return true;
+}
+
+
+void Blockchain::setMinerThreads(int threads)
+{
+    miner.setThreadCount(threads);
 }
 
 
-QByteArray Blockchain::nextHash(Block &block)
+/**
+ * @brief Replaces the retarget policy, used from the next block template on.
+ * Published like the ledger snapshot, std::atomic_store takes a short internal lock.
+ */
+void Blockchain::setDifficultyPolicy(std::shared_ptr<const DifficultyPolicy> policy)
+{
+    if (policy)
+        std::atomic_store(&difficultyPolicy, std::shared_ptr<const DifficultyPolicy>(std::move(policy)));
+}
+
+
+int Blockchain::getMinerThreads() const
+{
+    return miner.getThreadCount();
+}
+
+
+const Metrics &Blockchain::getMetrics() const
+{
+    return metrics;
+}
+
+
+/**
+ * @brief Registers the node metrics. The samplers read state owned by the
+ * event loop thread, so the metrics are rendered on that thread.
+ */
+void Blockchain::registerMetrics()
 {
-    block.setNonce(block.getNonce() + 1);
-    auto hash = block.calculateHash();
-    return std::move(hash);
+    blocksMined = &metrics.counter("simpleblockchain_blocks_mined_total", "Blocks mined by this node that became the tip.");
+    blocksAccepted = &metrics.counter("simpleblockchain_blocks_accepted_total", "Blocks added to the block tree, mined or received.");
+    blocksRejected = &metrics.counter("simpleblockchain_blocks_rejected_total", "Blocks that failed validation.");
+    bytesReceived = &metrics.counter("simpleblockchain_sync_received_bytes_total", "Bytes received from peers.");
+    bytesSent = &metrics.counter("simpleblockchain_sync_sent_bytes_total", "Bytes written to peers.");
+    transactionsReceived = &metrics.counter("simpleblockchain_transactions_received_total", "Transactions added to the mempool, submitted or relayed.");
+    transactionsConfirmed = &metrics.counter("simpleblockchain_transactions_confirmed_total", "Transactions in blocks that became part of the best chain.");
+    validationTime = &metrics.histogram("simpleblockchain_validation_seconds", "Time to validate a batch of received blocks.",
+                                        {0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5, 10});
+    reorgDepth = &metrics.histogram("simpleblockchain_reorg_depth_blocks", "Blocks replaced on each tip change, 0 when the tip is extended.",
+                                    {0, 1, 2, 4, 8, 16, 64, 256, 1024});
+    metrics.counter("simpleblockchain_network_seconds_total", "Time spent handling peer messages, tip announcements and transaction relays.", [this]() {
+        return networkTime / 1e9;
+    });
+    metrics.counter("simpleblockchain_hashes_total", "Hashes computed by the miner.", [this]() {
+        return double(miner.getHashCount());
+    });
+    // Rate between two renderings, which a scraper does at a steady interval
+    metrics.gauge("simpleblockchain_hash_rate", "Hashes per second since the previous scrape.",
+                  [this, lastCount = quint64(0), lastTime = QDateTime::currentMSecsSinceEpoch()]() mutable {
+        auto count = miner.getHashCount();
+        auto now = QDateTime::currentMSecsSinceEpoch();
+        auto rate = now > lastTime ? (count - lastCount) * 1000.0 / (now - lastTime) : 0.0;
+        lastCount = count;
+        lastTime = now;
+        return rate;
+    });
+    metrics.gauge("simpleblockchain_height", "Height of the tip, -1 without blocks.", [this]() {
+        return double(getLedger()->size() - 1);
+    });
+    metrics.gauge("simpleblockchain_difficulty_bits", "Difficulty of the block being mined, in bits.", [this]() {
+        return std::max(0, miningDifficulty.load()) / double(ChainWork::StepsPerBit);
+    });
+    metrics.gauge("simpleblockchain_peers", "Connected peers.", [this]() {
+        return double(peers.size());
+    });
+    metrics.gauge("simpleblockchain_peer_queued_bytes", "Bytes written to peers and not sent yet.", [this]() {
+        return double(getQueuedBytes());
+    });
+    metrics.gauge("simpleblockchain_lagging_peers", "Peers whose write queue is over the high watermark.", [this]() {
+        return double(std::count_if(peers.cbegin(), peers.cend(), [](const PeerState &peer) {
+            return peer.lagging;
+        }));
+    });
+    metrics.gauge("simpleblockchain_mempool_transactions", "Transactions waiting for a block.", [this]() {
+        return double(mempool.size());
+    });
+    metrics.gauge("simpleblockchain_mempool_bytes", "Size of the transactions waiting for a block.", [this]() {
+        return double(mempool.bytes());
+    });
+    metrics.gauge("simpleblockchain_orphan_blocks", "Blocks waiting for their parent.", [this]() {
+        QMutexLocker locker(&treeMutex);
+        return double(tree.orphanCount());
+    });
 }
@@ -6,27 +6,57 @@
 #include <QHostAddress>
 #include <QDateTime>
 #include <QTimer>
+#include <QColor>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QHash>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QThreadPool>
 
 #include <algorithm>
+#include <atomic>
+#include <memory>
 
+#include "Constants.h"
 #include "block.h"
-
-// Temp
-#include "QMessageBox"
+#include "blockstore.h"
+#include "blocktree.h"
+#include "difficultypolicy.h"
+#include "hashindex.h"
+#include "ledger.h"
+#include "mempool.h"
+#include "metrics.h"
+#include "miner.h"
+#include "peermanager.h"
+#include "protocol.h"
 
 #include <QObject>
 
 class Blockchain : public QObject
 {
     Q_OBJECT
+    friend class BlockchainBenchmark;
+    friend class ChainSimulator;
 public:
+    struct PeerStats
+    {
+        QString address;
+        bool outbound {false};
+        bool legacy {false};
+        int score {0};
+        qint64 queuedBytes {0};  // Written but not sent yet
+        bool lagging {false};
+        quint64 dropped {0};     // Messages superseded while lagging
+    };
+
     Blockchain(QObject *parent = nullptr);
     virtual ~Blockchain();
 
-    qint16 startServer();
-    bool connectToPort(qint64 port);
+    qint32 startServer(quint16 port = 0);
+    bool connectToPeer(const QString &host, quint16 port);
+    bool submitTransaction(const Transaction &transaction);
+    bool getProof(const QByteArray &blockHash, const QByteArray &transactionHash, Protocol::InclusionProof &proof);
 
 public slots:
     // Server
@@ -35,47 +65,138 @@ public slots:
     void onReadyReadServer();
 
     // Client
+    void onPeerConnected(QTcpSocket *server);
+    void onPeerDisconnected(QTcpSocket *server);
+    void onPeerUnreachable(QString host, quint16 port, qint64 retryDelay);
     void onReadyReadClient();
-    void onDisconnectedClient();
+    void onBytesWritten();
 
     // Ledger update
     void onBroadcastLedger();
+    void onAnnounceTip();
+    void onRelayTransactions();
+    void onBatchValidated(quint64 peerId, bool valid);
 
 signals:
     void blockMined(const Block &block, QColor color) const;
     void messageSent(QString message, QColor color) const;
     void updateAverage(qint64);
     void update10Average(qint64);
-    void difficultyChanged(qint64 diff);
+    void difficultyChanged(qint64 diff); // In steps of 1/ChainWork::StepsPerBit
     void broadcastLedger();
+    void batchValidated(quint64 peerId, bool valid);
+    void tipAnnounced(qint64 height, qint64 delay);
 
     // Miner
 public:
     void startMining();
+    void stopMining();
+    void setMinerThreads(int threads);
+    void setDifficultyPolicy(std::shared_ptr<const DifficultyPolicy> policy);
+    bool openStore(const QString &directory);
+    int getMinerThreads() const;
+    LedgerSnapshot getLedger() const;
+    QVector<PeerStats> getPeerStats() const;
+    qint64 getQueuedBytes() const;
+    const Metrics &getMetrics() const;
 
 private:
-    Block mine(const Block &prevBlock);
-    void addBlock(Block block);
+    Block mine(const Ledger &ledger);
+    bool addBlock(const Block &block);
     bool isBlockValid(const Block &block) const;
-    static bool isBlockValid(const Block &prev, const Block &block);
+    bool isHeaderValid(const BlockHeader &prev, const BlockHeader &header) const;
+    bool isHashValid(const Block &block) const;
     bool validateLedger() const;
     bool validateLedgerIntegrity() const;
-    bool validateLedger(const QVector<Block> &ledger);
+    bool validateLedger(const Ledger &ledger, qint64 from = 0) const;
     QByteArray getLedgerJson() const;
+    static bool parseLedgerJson(const QByteArray &json, QVector<Block> &blocks);
     void updateLedgerFromJson(QByteArray json);
-    qint64 cumulativeDifficulty();
-    qint64 cumulativeDifficulty(QVector<Block> &ledger);
-    QByteArray nextHash(Block &block);
+    void readFrames(QTcpSocket *peer);
+    void send(QTcpSocket *peer, Protocol::MessageType type, const QByteArray &message);
+    void adjustScore(QTcpSocket *peer, int delta, const QString &reason = QString());
+    void disconnectPeer(QTcpSocket *peer, const QString &reason);
+    static QString peerName(QTcpSocket *peer);
+    quint64 peerId(QTcpSocket *peer) const;
+    QTcpSocket *findPeer(quint64 id) const;
+    void handleMessage(QTcpSocket *peer, const FrameReader::Frame &frame);
+    void onTip(QTcpSocket *peer, const Protocol::TipInfo &tip);
+    void onBlocks(QTcpSocket *peer, const QVector<Block> &blocks);
+    bool acceptTransaction(QTcpSocket *source, const Transaction &transaction);
+    static QVector<Transaction> blockTransactions(const QByteArray &payload);
+    Protocol::TipInfo getTip();
+    QVector<QByteArray> getLocator(const Ledger &chain) const;
+    QVector<Block> blocksAfter(const QVector<QByteArray> &locator) const;
+    enum ConnectResult { Invalid, Known, Orphan, Connected };
+    void validateBatch(QTcpSocket *peer, const QVector<Block> &blocks);
+    bool validateBlocks(const QVector<Block> &blocks);
+    qsizetype verifyHashes(const QVector<Block> &blocks) const;
+    bool acceptBlocks(const QVector<Block> &blocks, bool hashesChecked = false);
+    ConnectResult connectBlock(const Block &block, bool hashChecked = false);
+    bool publishBestChain(bool restartMiner);
+    void requestAnnouncement();
+    void updateIndex(const Ledger &previous, const Ledger &next, qint64 fork);
+    void registerMetrics();
 
 private:
+    struct PeerState
+    {
+        quint64 id {0};          // Unique per connection, sockets may be reused after deletion
+        bool outbound {false};   // We connected to it
+        bool legacy {false};     // Only understands full ledgers
+        int score {PEER_INITIAL_SCORE}; // Disconnected at 0
+        bool closing {false};    // Disconnect queued, nothing is read or sent anymore
+        bool lagging {false};    // Write buffer went over the high watermark
+        qint64 laggingSince {0};
+        bool tipPending {false}; // Held back while lagging, sent when it catches up
+        bool ledgerPending {false};
+        quint64 dropped {0};
+        bool requested {false};  // Waiting for blocks
+        qint64 requestedAt {0};
+        Protocol::TipInfo tip;
+        FrameReader reader;
+    };
+
     QTcpServer *_server;
-    QTcpSocket *_socket;
+    PeerManager peerManager;
     QList<QTcpSocket*> clients;
-    QTimer *timer;
-    QVector<Block> ledger;
-    QDebug debug;
+    QHash<QTcpSocket*, PeerState> peers;
+    quint64 lastPeerId {0};
+    QTimer keepaliveTimer;
+    QTimer announceTimer;
+    std::atomic<bool> announcePending {false};
+    std::atomic<qint64> tipChangedAt {0};     // First change not announced yet
+    qint64 lastAnnouncement {0};
+    Mempool mempool {MEMPOOL_MAX_BYTES};
+    QTimer relayTimer;
+    QVector<QPair<quint64, Transaction>> relayQueue; // With the id of the peer it came from, not sent back there
+    LedgerSnapshot ledger {std::make_shared<const Ledger>()};
+    QMutex publishMutex;     // Serializes writers, readers only load the snapshot (briefly locked by std::atomic_load)
+    BlockTree tree;          // Changed under publishMutex and treeMutex, read under either
+    mutable QMutex treeMutex; // Held only while the tree changes, for readers on the event loop thread
+    HashIndex chainIndex;    // Hash -> height on the best chain, may be ahead of a loaded snapshot
+    mutable QReadWriteLock indexLock;
+    BlockStore store;
+    mutable QHash<QByteArray, Block> verifiedBlocks;
+    mutable QMutex verifiedMutex;
     bool minig {false};
-    bool updated {false};
+    std::atomic<bool> updated {false};
+    std::atomic<bool> stopping {false};
+    Miner miner;
+    std::shared_ptr<const DifficultyPolicy> difficultyPolicy {std::make_shared<ProportionalPolicy>(DIFF_RETARGET_WINDOW, DIFF_MAX_STEP)};
+    std::atomic<qint32> miningDifficulty {-1}; // Steps of the last template, -1 before the first
+    QThreadPool validationPool; // One thread, batches are validated in arrival order
+    Metrics metrics;
+    Metrics::Counter *blocksMined {nullptr};
+    Metrics::Counter *blocksAccepted {nullptr};
+    Metrics::Counter *blocksRejected {nullptr};
+    Metrics::Counter *bytesReceived {nullptr};
+    Metrics::Counter *bytesSent {nullptr};
+    Metrics::Counter *transactionsReceived {nullptr};
+    Metrics::Counter *transactionsConfirmed {nullptr};
+    Metrics::Histogram *validationTime {nullptr};
+    Metrics::Histogram *reorgDepth {nullptr};
+    std::atomic<quint64> networkTime {0}; // ns spent handling peer messages, announcements and relays
 };
 
 #endif // BLOCKCHAIN_H
@@ -0,0 +1,266 @@
+#include "blockstore.h"
+#include "Constants.h"
+
+#include <QDir>
+#include <QtEndian>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+
+BlockStore::~BlockStore()
+{
+    close();
+}
+
+
+/**
+ * @brief Opens or creates the store in the given directory and cuts off a torn tail.
+ */
+bool BlockStore::open(const QString &directory)
+{
+    QMutexLocker locker(&mutex);
+    if (log.isOpen())
+        return false;
+    if (!QDir().mkpath(directory))
+        return false;
+    log.setFileName(QDir(directory).filePath("blocks.dat"));
+    index.setFileName(QDir(directory).filePath("blocks.idx"));
+    if (!log.open(QIODevice::ReadWrite) || !index.open(QIODevice::ReadWrite)) {
+        log.close();
+        index.close();
+        return false;
+    }
+    logSize = log.size();
+    count = index.size() / 8;
+    unsynced = 0;
+    return recover();
+}
+
+
+void BlockStore::close()
+{
+    QMutexLocker locker(&mutex);
+    if (!log.isOpen())
+        return;
+    if (unsynced > 0) {
+        syncFile(log);
+        syncFile(index);
+    }
+    unmap();
+    log.close();
+    index.close();
+    count = 0;
+    logSize = 0;
+}
+
+
+bool BlockStore::isOpen() const
+{
+    return log.isOpen();
+}
+
+
+qint64 BlockStore::size() const
+{
+    return count;
+}
+
+
+/**
+ * @brief Appends the block at height size(). The record is written before its
+ * index entry, so a crash can only leave a record without an entry.
+ */
+bool BlockStore::append(const Block &block)
+{
+    QMutexLocker locker(&mutex);
+    if (!log.isOpen())
+        return false;
+    QByteArray record(RecordHeaderSize, '\0');
+    block.serialize(record);
+    auto *header = reinterpret_cast<uchar *>(record.data());
+    const quint32 length = record.size() - RecordHeaderSize;
+    qToBigEndian<quint32>(length, header);
+    qToBigEndian<quint16>(qChecksum(QByteArrayView(record.constData() + RecordHeaderSize, length)), header + 4);
+    uchar entry[8];
+    qToBigEndian<quint64>(logSize, entry);
+    if (!log.seek(logSize) || log.write(record) != record.size() || !log.flush())
+        return false;
+    if (!index.seek(count * 8) || index.write(reinterpret_cast<const char *>(entry), 8) != 8 || !index.flush())
+        return false;
+    logSize += record.size();
+    count++;
+    if (++unsynced >= STORE_SYNC_INTERVAL) {
+        syncFile(log);
+        syncFile(index);
+        unsynced = 0;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Drops every block from the given height on.
+ */
+bool BlockStore::truncate(qint64 height)
+{
+    QMutexLocker locker(&mutex);
+    if (!log.isOpen() || height < 0)
+        return false;
+    if (height >= count)
+        return true;
+    auto end = recordOffset(height);
+    if (end < 0)
+        return false;
+    unmap();
+    if (!log.resize(end) || !index.resize(height * 8))
+        return false;
+    logSize = end;
+    count = height;
+    unsynced = 0;
+    return syncFile(log) && syncFile(index);
+}
+
+
+/**
+ * @brief Decodes the block at the given height straight from the mapped log.
+ */
+bool BlockStore::blockAt(qint64 height, Block &block)
+{
+    QMutexLocker locker(&mutex);
+    if (recordEnd(height) < 0)
+        return false;
+    auto offset = recordOffset(height);
+    auto length = qFromBigEndian<quint32>(logMap + offset);
+    auto payload = QByteArray::fromRawData(reinterpret_cast<const char *>(logMap + offset + RecordHeaderSize), length);
+    Serializer::Reader reader(payload);
+    return Block::deserialize(reader, block) && reader.atEnd();
+}
+
+
+QVector<Block> BlockStore::readAll()
+{
+    QVector<Block> blocks;
+    blocks.reserve(count);
+    for (qint64 height = 0; height < size(); height++) {
+        Block block;
+        if (!blockAt(height, block))
+            break;
+        blocks.push_back(std::move(block));
+    }
+    return blocks;
+}
+
+
+bool BlockStore::sync()
+{
+    QMutexLocker locker(&mutex);
+    if (!log.isOpen())
+        return false;
+    unsynced = 0;
+    return syncFile(log) && syncFile(index);
+}
+
+
+/**
+ * @brief Drops index entries whose record is missing or damaged, then cuts
+ * both files to the last complete block. Only the tail is checked.
+ */
+bool BlockStore::recover()
+{
+    while (count > 0 && recordEnd(count - 1) < 0)
+        count--;
+    qint64 end = count > 0 ? recordEnd(count - 1) : 0;
+    if (end == logSize && count * 8 == index.size())
+        return true;
+    unmap();
+    if (!log.resize(end) || !index.resize(count * 8))
+        return false;
+    logSize = end;
+    return syncFile(log) && syncFile(index);
+}
+
+
+/**
+ * @brief End offset of the record at the given height.
+ * @return -1 if the record is out of range or its checksum does not match
+ */
+qint64 BlockStore::recordEnd(qint64 height)
+{
+    auto offset = recordOffset(height);
+    if (offset < 0 || offset + RecordHeaderSize > logSize)
+        return -1;
+    if (offset + RecordHeaderSize > logMapSize && !remap(logSize, count * 8))
+        return -1;
+    auto length = qFromBigEndian<quint32>(logMap + offset);
+    auto end = offset + RecordHeaderSize + length;
+    if (end > logSize)
+        return -1;
+    if (end > logMapSize && !remap(logSize, count * 8))
+        return -1;
+    auto checksum = qFromBigEndian<quint16>(logMap + offset + 4);
+    if (qChecksum(QByteArrayView(logMap + offset + RecordHeaderSize, length)) != checksum)
+        return -1;
+    return end;
+}
+
+
+qint64 BlockStore::recordOffset(qint64 height)
+{
+    if (height < 0 || height >= count)
+        return -1;
+    if ((height + 1) * 8 > indexMapSize && !remap(logSize, count * 8))
+        return -1;
+    return qint64(qFromBigEndian<quint64>(indexMap + height * 8));
+}
+
+
+/**
+ * @brief Maps the given file sizes. Appends grow the files past the mapping,
+ * so reads remap lazily once they reach beyond it.
+ */
+bool BlockStore::remap(qint64 logBytes, qint64 indexBytes)
+{
+    unmap();
+    if (logBytes > 0) {
+        logMap = log.map(0, logBytes);
+        if (!logMap)
+            return false;
+        logMapSize = logBytes;
+    }
+    if (indexBytes > 0) {
+        indexMap = index.map(0, indexBytes);
+        if (!indexMap)
+            return false;
+        indexMapSize = indexBytes;
+    }
+    return true;
+}
+
+
+void BlockStore::unmap()
+{
+    if (logMap)
+        log.unmap(logMap);
+    if (indexMap)
+        index.unmap(indexMap);
+    logMap = nullptr;
+    indexMap = nullptr;
+    logMapSize = 0;
+    indexMapSize = 0;
+}
+
+
+bool BlockStore::syncFile(QFile &file)
+{
+    if (!file.flush())
+        return false;
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return fsync(file.handle()) == 0;
+#endif
+}
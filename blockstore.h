@@ -0,0 +1,58 @@
+#ifndef BLOCKSTORE_H
+#define BLOCKSTORE_H
+
+#include <QFile>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+
+#include "block.h"
+
+/**
+ * @brief Append-only on-disk ledger. blocks.dat holds the records
+ * (4-byte length, 2-byte CRC-16, serialized block), blocks.idx holds one
+ * 8-byte record offset per height. Both files are memory-mapped for reads.
+ * Records are written before their index entry and flushed to disk every
+ * STORE_SYNC_INTERVAL blocks; a torn tail left by a crash is cut off on open.
+ */
+class BlockStore
+{
+public:
+    BlockStore() = default;
+    ~BlockStore();
+
+    bool open(const QString &directory);
+    void close();
+    bool isOpen() const;
+
+    qint64 size() const;
+    bool append(const Block &block);
+    bool truncate(qint64 height);
+    bool blockAt(qint64 height, Block &block);
+    QVector<Block> readAll();
+    bool sync();
+
+private:
+    static constexpr int RecordHeaderSize = 6;
+
+    bool recover();
+    qint64 recordEnd(qint64 height);
+    qint64 recordOffset(qint64 height);
+    bool remap(qint64 logBytes, qint64 indexBytes);
+    void unmap();
+    static bool syncFile(QFile &file);
+
+private:
+    QFile log;
+    QFile index;
+    uchar *logMap {nullptr};
+    uchar *indexMap {nullptr};
+    qint64 logMapSize {0};
+    qint64 indexMapSize {0};
+    qint64 logSize {0};
+    qint64 count {0};
+    int unsynced {0};
+    QMutex mutex;
+};
+
+#endif // BLOCKSTORE_H
@@ -0,0 +1,201 @@
+#include "blocktree.h"
+
+
+BlockTree::BlockTree(qsizetype maxOrphans)
+    : maxOrphans(maxOrphans)
+{
+
+}
+
+
+qsizetype BlockTree::size() const
+{
+    return nodes.size();
+}
+
+
+bool BlockTree::contains(const QByteArray &hash) const
+{
+    return nodes.contains(hash);
+}
+
+
+/**
+ * @brief The node of the given block, nullptr if unknown. Valid until the next insert, prune or restore.
+ */
+const BlockTree::Node *BlockTree::find(const QByteArray &hash) const
+{
+    auto it = nodes.constFind(hash);
+    return it == nodes.constEnd() ? nullptr : &*it;
+}
+
+
+/**
+ * @brief Adds a validated block whose parent is in the tree, or a genesis
+ * block, and makes it the best tip if its branch has the most work.
+ * @return False if the block is known, its parent is not or its hashes cannot be stored
+ */
+bool BlockTree::insert(const Block &block)
+{
+    if (nodes.contains(block.getHash()))
+        return false;
+    Node node;
+    if (!block.getHeader(node.header))
+        return false;
+    node.payload = block.getData();
+    node.work = ChainWork::fromDifficultySteps(block.getDifficultySteps());
+    node.sequence = ++sequence;
+    if (block.getIndex() != 0) {
+        auto parent = nodes.find(block.getPrevHash());
+        if (parent == nodes.end())
+            return false;
+        node.work += parent->work;
+        parent->children++;
+        leaves.remove(block.getPrevHash());
+    }
+    auto work = node.work;
+    nodes.insert(block.getHash(), std::move(node));
+    leaves.insert(block.getHash());
+    // Ties keep the branch seen first
+    if (best.isEmpty() || work > getBestWork())
+        best = block.getHash();
+    return true;
+}
+
+
+/**
+ * @brief Hash of the tip of the branch with the most work, empty if the tree is empty.
+ */
+const QByteArray &BlockTree::getBest() const
+{
+    return best;
+}
+
+
+ChainWork BlockTree::getBestWork() const
+{
+    auto it = nodes.constFind(best);
+    return it == nodes.constEnd() ? ChainWork() : it->work;
+}
+
+
+/**
+ * @brief Drops the payloads of the best chain below the height, and removes
+ * side branches whose tip is older than the last staleAge blocks inserted.
+ * A side branch that is being downloaded grows with every batch and stays.
+ * Only the best chain heights that still have payloads are visited.
+ */
+void BlockTree::prune(qint64 height, quint64 staleAge)
+{
+    if (height > prunedHeight) {
+        for (auto hash = best; !hash.isEmpty(); ) {
+            auto node = nodes.find(hash);
+            if (node == nodes.end() || node->header.index < prunedHeight)
+                break;
+            if (node->header.index < height) {
+                node->payload = QByteArray();
+                node->pruned = true;
+            }
+            hash = node->header.getPrevHash();
+        }
+        prunedHeight = height;
+    }
+    if (sequence <= staleAge)
+        return;
+    for (const auto &leaf : QSet<QByteArray>(leaves)) {
+        if (leaf != best && nodes.value(leaf).sequence < sequence - staleAge)
+            removeBranch(leaf);
+    }
+}
+
+
+/**
+ * @brief Gives a pruned block its payload back. Called for the blocks that
+ * leave the best chain, so that a side branch can always be switched to.
+ */
+void BlockTree::restore(const QByteArray &hash, const QByteArray &payload)
+{
+    auto node = nodes.find(hash);
+    if (node == nodes.end() || !node->pruned)
+        return;
+    node->payload = payload;
+    node->pruned = false;
+    prunedHeight = std::min(prunedHeight, node->header.index);
+}
+
+
+/**
+ * @brief Removes the tip and its ancestors down to the first block another branch grows from.
+ */
+void BlockTree::removeBranch(const QByteArray &leaf)
+{
+    auto hash = leaf;
+    while (true) {
+        auto node = nodes.find(hash);
+        if (node == nodes.end() || node->children > 0 || hash == best)
+            return;
+        auto parentHash = node->header.getPrevHash();
+        nodes.erase(node);
+        leaves.remove(hash);
+        auto parent = nodes.find(parentHash);
+        if (parent == nodes.end() || --parent->children > 0)
+            return;
+        leaves.insert(parentHash);
+        hash = parentHash;
+    }
+}
+
+
+qsizetype BlockTree::orphanCount() const
+{
+    return orphans.size();
+}
+
+
+bool BlockTree::isOrphan(const QByteArray &hash) const
+{
+    return orphans.contains(hash);
+}
+
+
+/**
+ * @brief Keeps a block whose parent is unknown, the oldest orphan is dropped when the pool is full.
+ */
+void BlockTree::addOrphan(const Block &block)
+{
+    if (maxOrphans <= 0 || orphans.contains(block.getHash()) || nodes.contains(block.getHash()))
+        return;
+    while (orphans.size() >= maxOrphans && !orphanOrder.isEmpty()) {
+        auto hash = orphanOrder.dequeue();
+        auto it = orphans.find(hash);
+        if (it == orphans.end())
+            continue;
+        orphanChildren.remove(it->getPrevHash(), hash);
+        orphans.erase(it);
+    }
+    orphans.insert(block.getHash(), block);
+    orphanChildren.insert(block.getPrevHash(), block.getHash());
+    orphanOrder.enqueue(block.getHash());
+}
+
+
+/**
+ * @brief Removes and returns the orphans waiting for the given block.
+ */
+QVector<Block> BlockTree::takeOrphans(const QByteArray &parentHash)
+{
+    QVector<Block> children;
+    for (const auto &hash : orphanChildren.values(parentHash))
+        children.push_back(orphans.take(hash));
+    orphanChildren.remove(parentHash);
+    // Taken hashes stay in orphanOrder and are skipped on eviction, compact it when it gets long
+    if (orphanOrder.size() > 2 * std::max<qsizetype>(maxOrphans, orphans.size())) {
+        QQueue<QByteArray> order;
+        for (const auto &hash : orphanOrder) {
+            if (orphans.contains(hash))
+                order.enqueue(hash);
+        }
+        orphanOrder = std::move(order);
+    }
+    return children;
+}
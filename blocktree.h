@@ -0,0 +1,69 @@
+#ifndef BLOCKTREE_H
+#define BLOCKTREE_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QMultiHash>
+#include <QQueue>
+#include <QSet>
+#include <QVector>
+
+#include "block.h"
+#include "chainwork.h"
+
+/**
+ * @brief Every valid block the node knows of, keyed by hash, with the branch
+ * of most work marked as the best one. Blocks whose parent is unknown wait in
+ * a bounded orphan pool until it arrives. The tree does not validate, callers
+ * insert blocks they validated against their parent.
+ *
+ * prune() bounds its memory without limiting forks: the best chain below a
+ * given height keeps only its headers, the ledger holds the payloads, and
+ * side branches that stopped growing are removed. A branch forking at any
+ * height is still followed once it has the most work.
+ */
+class BlockTree
+{
+public:
+    struct Node
+    {
+        BlockHeader header;
+        QByteArray payload;
+        ChainWork work; // Cumulative, including this block
+        bool pruned {false}; // On the best chain, the payload was dropped
+        int children {0};
+        quint64 sequence {0}; // Insertion order
+    };
+
+    BlockTree(qsizetype maxOrphans);
+
+    qsizetype size() const;
+    bool contains(const QByteArray &hash) const;
+    const Node *find(const QByteArray &hash) const;
+    bool insert(const Block &block);
+    const QByteArray &getBest() const;
+    ChainWork getBestWork() const;
+    void prune(qint64 height, quint64 staleAge);
+    void restore(const QByteArray &hash, const QByteArray &payload);
+
+    qsizetype orphanCount() const;
+    bool isOrphan(const QByteArray &hash) const;
+    void addOrphan(const Block &block);
+    QVector<Block> takeOrphans(const QByteArray &parentHash);
+
+private:
+    void removeBranch(const QByteArray &leaf);
+
+private:
+    QHash<QByteArray, Node> nodes;
+    QSet<QByteArray> leaves;    // Nodes without children, the tips of all branches
+    quint64 sequence {0};
+    qint64 prunedHeight {0};    // The best chain below it has no payloads
+    QByteArray best;
+    QHash<QByteArray, Block> orphans;
+    QMultiHash<QByteArray, QByteArray> orphanChildren; // Parent hash -> orphan hashes
+    QQueue<QByteArray> orphanOrder;                    // Oldest first, may hold taken ones
+    qsizetype maxOrphans;
+};
+
+#endif // BLOCKTREE_H
@@ -0,0 +1,130 @@
+#include "chainwork.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstring>
+
+
+/**
+ * @brief Work of a single block whose difficulty is z bits and f steps of
+ * 1/StepsPerBit: 2^(z+8) / (256 - f), which is 2^z for whole bits. Unless
+ * 256 - f is a power of two the quotient is truncated, losing less than one
+ * hash per block. Blocks below difficulty 0 add nothing.
+ */
+ChainWork ChainWork::fromDifficultySteps(qint32 steps)
+{
+    ChainWork work;
+    if (steps < 0)
+        return work;
+    auto bit = std::min(steps / StepsPerBit, 247) + 8;
+    quint64 divisor = StepsPerBit - steps % StepsPerBit;
+    work.words[bit / 64] = quint64(1) << (bit % 64);
+    // Long division in 32-bit digits, most significant first
+    quint64 remainder = 0;
+    for (int i = 3; i >= 0; i--) {
+        quint64 high = (remainder << 32) | (work.words[i] >> 32);
+        remainder = high % divisor;
+        quint64 low = (remainder << 32) | (work.words[i] & 0xffffffff);
+        remainder = low % divisor;
+        work.words[i] = ((high / divisor) << 32) | (low / divisor);
+    }
+    return work;
+}
+
+
+/**
+ * @brief Reads a big-endian value of at most 32 bytes.
+ */
+bool ChainWork::fromBytes(const QByteArray &bytes, ChainWork &work)
+{
+    if (bytes.size() > 32)
+        return false;
+    uchar buffer[32] = {};
+    memcpy(buffer + 32 - bytes.size(), bytes.constData(), bytes.size());
+    for (int i = 0; i < 4; i++)
+        work.words[i] = qFromBigEndian<quint64>(buffer + 24 - 8 * i);
+    return true;
+}
+
+
+/**
+ * @brief Big-endian value without leading zero bytes.
+ */
+QByteArray ChainWork::toBytes() const
+{
+    uchar buffer[32];
+    for (int i = 0; i < 4; i++)
+        qToBigEndian<quint64>(words[i], buffer + 24 - 8 * i);
+    int start = 0;
+    while (start < 32 && buffer[start] == 0)
+        start++;
+    return QByteArray(reinterpret_cast<const char *>(buffer + start), 32 - start);
+}
+
+
+bool ChainWork::isZero() const
+{
+    return words == std::array<quint64, 4> {};
+}
+
+
+ChainWork &ChainWork::operator+=(const ChainWork &other)
+{
+    quint64 carry = 0;
+    for (int i = 0; i < 4; i++) {
+        auto sum = words[i] + other.words[i];
+        auto next = sum < words[i];
+        words[i] = sum + carry;
+        carry = next || words[i] < sum;
+    }
+    return *this;
+}
+
+
+ChainWork ChainWork::operator+(const ChainWork &other) const
+{
+    auto result = *this;
+    result += other;
+    return result;
+}
+
+
+bool ChainWork::operator==(const ChainWork &other) const
+{
+    return words == other.words;
+}
+
+
+bool ChainWork::operator!=(const ChainWork &other) const
+{
+    return words != other.words;
+}
+
+
+bool ChainWork::operator<(const ChainWork &other) const
+{
+    for (int i = 3; i >= 0; i--) {
+        if (words[i] != other.words[i])
+            return words[i] < other.words[i];
+    }
+    return false;
+}
+
+
+bool ChainWork::operator>(const ChainWork &other) const
+{
+    return other < *this;
+}
+
+
+bool ChainWork::operator<=(const ChainWork &other) const
+{
+    return !(other < *this);
+}
+
+
+bool ChainWork::operator>=(const ChainWork &other) const
+{
+    return !(*this < other);
+}
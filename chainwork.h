@@ -0,0 +1,39 @@
+#ifndef CHAINWORK_H
+#define CHAINWORK_H
+
+#include <QByteArray>
+
+#include <array>
+
+/**
+ * @brief Unsigned 256-bit amount of work. A block is worth the number of
+ * hashes expected to meet its difficulty, truncated to a whole number below
+ * one hash off. Every node truncates the same way, so sums and comparisons of
+ * the same blocks agree between nodes.
+ */
+class ChainWork
+{
+public:
+    static constexpr qint32 StepsPerBit = 256;
+
+    ChainWork() = default;
+
+    static ChainWork fromDifficultySteps(qint32 steps);
+    static bool fromBytes(const QByteArray &bytes, ChainWork &work);
+    QByteArray toBytes() const;
+    bool isZero() const;
+
+    ChainWork &operator+=(const ChainWork &other);
+    ChainWork operator+(const ChainWork &other) const;
+    bool operator==(const ChainWork &other) const;
+    bool operator!=(const ChainWork &other) const;
+    bool operator<(const ChainWork &other) const;
+    bool operator>(const ChainWork &other) const;
+    bool operator<=(const ChainWork &other) const;
+    bool operator>=(const ChainWork &other) const;
+
+private:
+    std::array<quint64, 4> words {}; // Least significant first
+};
+
+#endif // CHAINWORK_H
@@ -0,0 +1,56 @@
+#include "difficultypolicy.h"
+#include "Constants.h"
+#include "chainwork.h"
+#include "ledger.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+qint32 StepPolicy::nextDifficulty(const Ledger &ledger, qint64 timestamp) const
+{
+    if (ledger.isEmpty())
+        return DEFAULT_DIFF * ChainWork::StepsPerBit;
+    auto steps = ledger.back().getDifficultySteps();
+    if (ledger.size() < DIFF_ADJUST_INTERVAL)
+        return steps;
+    const qint64 timeExpected = BLOCK_GENERATION_INTERVAL * DIFF_ADJUST_INTERVAL;
+    auto timeTaken = timestamp - ledger.header(ledger.size() - DIFF_ADJUST_INTERVAL).timestamp;
+    if (timeTaken < timeExpected / 2)
+        steps += ChainWork::StepsPerBit;
+    else if (timeTaken > timeExpected * 2)
+        steps -= ChainWork::StepsPerBit;
+    return std::max(0, steps);
+}
+
+
+ProportionalPolicy::ProportionalPolicy(qint64 window, qint32 maxStep)
+    : window(std::max<qint64>(1, window))
+    , maxStep(std::max(1, maxStep))
+{
+}
+
+
+/**
+ * @brief The window spans from the timestamp of its first block to the given
+ * one, so the block being mined counts as its last interval. Shorter chains
+ * use the blocks they have, the genesis block gets DEFAULT_DIFF.
+ */
+qint32 ProportionalPolicy::nextDifficulty(const Ledger &ledger, qint64 timestamp) const
+{
+    if (ledger.isEmpty())
+        return DEFAULT_DIFF * ChainWork::StepsPerBit;
+    const auto count = std::min(window, ledger.size());
+    const auto first = ledger.size() - count;
+    qint64 total = 0;
+    for (auto height = first; height < ledger.size(); height++)
+        total += ledger.header(height).getDifficultySteps();
+    const double mean = double(total) / count;
+    const double expected = double(BLOCK_GENERATION_INTERVAL) * count;
+    // Timestamps are not ordered, keep the ratio finite and sane
+    const double taken = std::clamp(double(timestamp - ledger.header(first).timestamp), expected / 16, expected * 16);
+    const double target = mean + ChainWork::StepsPerBit * std::log2(expected / taken);
+    const auto prev = ledger.back().getDifficultySteps();
+    const auto steps = std::clamp<qint64>(std::llround(target), qint64(prev) - maxStep, qint64(prev) + maxStep);
+    return qint32(std::max<qint64>(0, steps));
+}
@@ -0,0 +1,50 @@
+#ifndef DIFFICULTYPOLICY_H
+#define DIFFICULTYPOLICY_H
+
+#include <QtGlobal>
+
+class Ledger;
+
+/**
+ * @brief Picks the difficulty of the next block, in steps of
+ * 1/ChainWork::StepsPerBit. It is asked once per block template, never in
+ * the nonce search, so it may look at as many headers as it needs.
+ */
+class DifficultyPolicy
+{
+public:
+    virtual ~DifficultyPolicy() = default;
+
+    virtual qint32 nextDifficulty(const Ledger &ledger, qint64 timestamp) const = 0;
+};
+
+/**
+ * @brief Moves the difficulty by a whole bit when the last
+ * DIFF_ADJUST_INTERVAL blocks took less than half or more than twice the
+ * expected time, keeps it otherwise.
+ */
+class StepPolicy : public DifficultyPolicy
+{
+public:
+    qint32 nextDifficulty(const Ledger &ledger, qint64 timestamp) const override;
+};
+
+/**
+ * @brief Sets the difficulty to the mean of the last window blocks, corrected
+ * by log2 of how much faster than expected they came. The change from the
+ * previous block is limited to maxStep steps, so a single odd timestamp
+ * cannot swing it.
+ */
+class ProportionalPolicy : public DifficultyPolicy
+{
+public:
+    ProportionalPolicy(qint64 window, qint32 maxStep);
+
+    qint32 nextDifficulty(const Ledger &ledger, qint64 timestamp) const override;
+
+private:
+    qint64 window;
+    qint32 maxStep;
+};
+
+#endif // DIFFICULTYPOLICY_H
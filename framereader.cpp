@@ -0,0 +1,141 @@
+#include "framereader.h"
+#include "Constants.h"
+
+#include <QtEndian>
+
+#include <algorithm>
+
+
+void FrameReader::append(const QByteArray &bytes)
+{
+    if (buffer.isEmpty())
+        buffer = bytes; // Implicitly shared, no copy
+    else
+        buffer.append(bytes);
+}
+
+
+/**
+ * @brief Takes the next complete frame out of the buffer. The payload is the
+ * only copy made of the frame bytes.
+ * @return False if no complete frame is buffered or the stream is invalid
+ */
+bool FrameReader::next(Frame &frame)
+{
+    if (error)
+        return false;
+    if (mode == Unknown) {
+        if (offset == buffer.size())
+            return false;
+        mode = buffer.at(offset) == '{' ? Legacy : Framed;
+    }
+    auto found = mode == Legacy ? nextLegacy(frame) : nextFramed(frame);
+    if (!found)
+        compact();
+    return found;
+}
+
+
+bool FrameReader::isLegacy() const
+{
+    return mode == Legacy;
+}
+
+
+bool FrameReader::hasError() const
+{
+    return error;
+}
+
+
+qsizetype FrameReader::bufferedBytes() const
+{
+    return buffer.size() - offset;
+}
+
+
+QByteArray FrameReader::frame(quint8 type, const QByteArray &payload)
+{
+    QByteArray bytes(HeaderSize + payload.size(), Qt::Uninitialized);
+    auto *data = reinterpret_cast<uchar *>(bytes.data());
+    qToBigEndian<quint32>(payload.size(), data);
+    data[4] = type;
+    memcpy(data + HeaderSize, payload.constData(), payload.size());
+    return bytes;
+}
+
+
+bool FrameReader::nextFramed(Frame &frame)
+{
+    auto available = buffer.size() - offset;
+    if (available < HeaderSize)
+        return false;
+    auto *data = reinterpret_cast<const uchar *>(buffer.constData()) + offset;
+    quint32 length = qFromBigEndian<quint32>(data);
+    if (length > MAX_FRAME_SIZE) {
+        error = true;
+        return false;
+    }
+    if (available < HeaderSize + qsizetype(length)) {
+        // Grow once for the rest of the frame instead of on every read
+        buffer.reserve(offset + HeaderSize + length);
+        return false;
+    }
+    frame.type = data[4];
+    frame.payload = buffer.mid(offset + HeaderSize, length);
+    offset += HeaderSize + length;
+    return true;
+}
+
+
+bool FrameReader::nextLegacy(Frame &frame)
+{
+    // Skip whitespace between documents
+    while (depth == 0 && offset < buffer.size() && buffer.at(offset) != '{')
+        offset++;
+    scanPos = std::max(scanPos, offset);
+    for (; scanPos < buffer.size(); scanPos++) {
+        auto c = buffer.at(scanPos);
+        if (inString) {
+            if (escaped)
+                escaped = false;
+            else if (c == '\\')
+                escaped = true;
+            else if (c == '"')
+                inString = false;
+        } else if (c == '"') {
+            inString = true;
+        } else if (c == '{') {
+            depth++;
+        } else if (c == '}' && --depth == 0) {
+            scanPos++;
+            frame.type = LegacyType;
+            frame.payload = buffer.mid(offset, scanPos - offset);
+            offset = scanPos;
+            return true;
+        }
+    }
+    if (buffer.size() - offset > MAX_FRAME_SIZE)
+        error = true;
+    return false;
+}
+
+
+/**
+ * @brief Drops consumed bytes. The unread tail is only moved once it is at most
+ * half the buffer, so every byte is moved at most once on average.
+ */
+void FrameReader::compact()
+{
+    if (offset == 0)
+        return;
+    if (offset == buffer.size()) {
+        buffer.clear();
+        scanPos = 0;
+        offset = 0;
+    } else if (offset >= buffer.size() / 2) {
+        buffer.remove(0, offset);
+        scanPos -= offset;
+        offset = 0;
+    }
+}
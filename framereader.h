@@ -0,0 +1,59 @@
+#ifndef FRAMEREADER_H
+#define FRAMEREADER_H
+
+#include <QByteArray>
+
+/**
+ * @brief Per-connection reassembly of peer messages. Frames are a 4-byte
+ * big-endian payload length, a 1-byte message type and the payload. Bytes are
+ * appended as they arrive and next() returns every complete frame, so frames
+ * split over several reads or sharing one read are both handled.
+ *
+ * A stream whose first byte is '{' comes from a peer on the old protocol,
+ * which writes bare JSON documents. Those are split on the closing brace of
+ * each top-level object and returned with type LegacyType.
+ */
+class FrameReader
+{
+public:
+    static constexpr int HeaderSize = 5;
+    static constexpr quint8 LegacyType = 1;
+
+    struct Frame
+    {
+        quint8 type {0};
+        QByteArray payload;
+    };
+
+    void append(const QByteArray &bytes);
+    bool next(Frame &frame);
+    bool isLegacy() const;
+    bool hasError() const;
+    qsizetype bufferedBytes() const;
+
+    static QByteArray frame(quint8 type, const QByteArray &payload);
+
+private:
+    bool nextFramed(Frame &frame);
+    bool nextLegacy(Frame &frame);
+    void compact();
+
+private:
+    enum Mode {
+        Unknown,
+        Framed,
+        Legacy
+    };
+
+    QByteArray buffer;
+    qsizetype offset {0};
+    Mode mode {Unknown};
+    bool error {false};
+    // Legacy JSON scan state, kept between reads
+    qsizetype scanPos {0};
+    int depth {0};
+    bool inString {false};
+    bool escaped {false};
+};
+
+#endif // FRAMEREADER_H
@@ -0,0 +1,127 @@
+#include "hashindex.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+qsizetype HashIndex::size() const
+{
+    return count;
+}
+
+
+/**
+ * @brief Makes room for the given number of entries without growing again.
+ */
+void HashIndex::reserve(qsizetype entries)
+{
+    qsizetype capacity = 16;
+    while (capacity < entries * 2)
+        capacity *= 2;
+    if (capacity > qsizetype(slots.size()))
+        rehash(capacity);
+}
+
+
+void HashIndex::clear()
+{
+    slots.clear();
+    count = 0;
+}
+
+
+/**
+ * @brief Adds the key, or replaces its value if it is in the table already.
+ */
+void HashIndex::insert(const Key &key, qint64 value)
+{
+    if ((count + 1) * 2 > qsizetype(slots.size()))
+        rehash(std::max<qsizetype>(16, slots.size() * 2));
+    auto i = locate(key);
+    if (!slots[i].used) {
+        slots[i].key = key;
+        slots[i].used = true;
+        count++;
+    }
+    slots[i].value = value;
+}
+
+
+bool HashIndex::remove(const Key &key)
+{
+    if (slots.empty())
+        return false;
+    auto i = locate(key);
+    if (!slots[i].used)
+        return false;
+    // Move back every following entry that may not be reachable past the hole
+    const auto mask = qsizetype(slots.size()) - 1;
+    for (auto j = (i + 1) & mask; slots[j].used; j = (j + 1) & mask) {
+        auto wanted = home(slots[j].key);
+        // The entry stays if its home slot lies cyclically in (i, j]
+        auto stays = i <= j ? (i < wanted && wanted <= j) : (i < wanted || wanted <= j);
+        if (!stays) {
+            slots[i] = slots[j];
+            i = j;
+        }
+    }
+    slots[i].used = false;
+    count--;
+    return true;
+}
+
+
+/**
+ * @return The value, -1 if the key is not in the table
+ */
+qint64 HashIndex::find(const Key &key) const
+{
+    if (slots.empty())
+        return -1;
+    const auto &slot = slots[locate(key)];
+    return slot.used ? slot.value : -1;
+}
+
+
+qint64 HashIndex::find(const QByteArray &hash) const
+{
+    if (hash.size() != 32)
+        return -1;
+    Key key;
+    memcpy(key.data(), hash.constData(), 32);
+    return find(key);
+}
+
+
+qsizetype HashIndex::home(const Key &key) const
+{
+    quint64 hash;
+    memcpy(&hash, key.data() + key.size() - sizeof(hash), sizeof(hash));
+    return qsizetype(hash & (slots.size() - 1));
+}
+
+
+/**
+ * @brief Slot holding the key, or the free slot where it would go.
+ */
+qsizetype HashIndex::locate(const Key &key) const
+{
+    const auto mask = qsizetype(slots.size()) - 1;
+    auto i = home(key);
+    while (slots[i].used && slots[i].key != key)
+        i = (i + 1) & mask;
+    return i;
+}
+
+
+void HashIndex::rehash(qsizetype capacity)
+{
+    auto old = std::move(slots);
+    slots.assign(capacity, Slot());
+    for (const auto &slot : old) {
+        if (!slot.used)
+            continue;
+        auto i = locate(slot.key);
+        slots[i] = slot;
+    }
+}
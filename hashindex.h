@@ -0,0 +1,48 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <QByteArray>
+
+#include <vector>
+
+#include "block.h"
+
+/**
+ * @brief Open-addressing hash table from 32-byte block hashes to heights.
+ * Keys are SHA-256 digests, so their last bytes serve as the table hash as
+ * they are; the first ones are the zeros proof of work asks for. Slots are
+ * probed linearly and removal shifts the following entries back, so there
+ * are no tombstones and lookups stay short after many reorgs. The table
+ * grows to keep at most half of the slots in use.
+ */
+class HashIndex
+{
+public:
+    typedef BlockHeader::Hash Key;
+
+    qsizetype size() const;
+    void reserve(qsizetype entries);
+    void clear();
+    void insert(const Key &key, qint64 value);
+    bool remove(const Key &key);
+    qint64 find(const Key &key) const;
+    qint64 find(const QByteArray &hash) const;
+
+private:
+    struct Slot
+    {
+        Key key;
+        qint64 value;
+        bool used {false};
+    };
+
+    qsizetype home(const Key &key) const;
+    qsizetype locate(const Key &key) const;
+    void rehash(qsizetype capacity);
+
+private:
+    std::vector<Slot> slots; // Power of two in size
+    qsizetype count {0};
+};
+
+#endif // HASHINDEX_H
@@ -0,0 +1,184 @@
+#include "headerhasher.h"
+
+
+HeaderHasher::HeaderHasher(const Block &block)
+{
+    uchar header[Block::HeaderSize];
+    block.writeHeader(header);
+    midstate = Sha256::initialState;
+    Sha256::compress(midstate, header);
+    preState = midstate;
+    for (int i = 0; i < PreRounds; i++) {
+        tail[i] = Sha256::load(header + 64 + i * 4);
+        Sha256::round(preState, Sha256::k[i], tail[i]);
+    }
+}
+
+
+/**
+ * @brief Computes the header hash for the given nonce.
+ * @param digest Buffer of 32 bytes
+ */
+void HeaderHasher::hash(qint64 nonce, uchar *digest) const
+{
+    Sha256::State state;
+    scalarKernel(midstate.data(), preState.data(), tail, nonce, state.data());
+    Sha256::store(state, digest);
+}
+
+
+/**
+ * @brief Computes the final states for nonces firstNonce .. firstNonce + getLanes() - 1.
+ * @param states Buffer of 8 * getLanes() words, written word-major: states[word * getLanes() + lane]
+ */
+void HeaderHasher::hashLanes(qint64 firstNonce, quint32 *states) const
+{
+    selectedKernel().function(midstate.data(), preState.data(), tail, firstNonce, states);
+}
+
+
+/**
+ * @brief Same with the kernel of the given backend, whether it is selected or not.
+ * @param lanes Set to the lane count of the kernel
+ * @return False if the CPU does not support the backend
+ */
+bool HeaderHasher::hashLanes(Backend backend, qint64 firstNonce, quint32 *states, int &lanes) const
+{
+    Kernel kernel;
+    if (!kernelFor(backend, kernel))
+        return false;
+    kernel.function(midstate.data(), preState.data(), tail, firstNonce, states);
+    lanes = kernel.lanes;
+    return true;
+}
+
+
+HeaderHasher::Backend HeaderHasher::getBackend()
+{
+    return selectedKernel().backend;
+}
+
+
+int HeaderHasher::getLanes()
+{
+    return selectedKernel().lanes;
+}
+
+
+QString HeaderHasher::getBackendName()
+{
+    return getBackendName(getBackend());
+}
+
+
+QString HeaderHasher::getBackendName(Backend backend)
+{
+    switch (backend) {
+    case Sse41:
+        return "SSE4.1";
+    case Avx2:
+        return "AVX2";
+    case Avx512:
+        return "AVX-512";
+    default:
+        return "Scalar";
+    }
+}
+
+
+/**
+ * @brief Checks every lane of a kernel against QCryptographicHash over the full header.
+ * @return True if the backend is supported by the CPU and all lanes match
+ */
+bool HeaderHasher::selfTest(Backend backend)
+{
+    Kernel kernel;
+    if (!kernelFor(backend, kernel))
+        return false;
+    Block block(7, 1700000000000, "Self test", QByteArray(32, '\x5a'), QByteArray(32, '\xa5'), 0, 1, Block::HeaderVersion);
+    HeaderHasher hasher(block);
+    // Cross the 32-bit boundary so both nonce words differ between lanes
+    const qint64 firstNonce = 0xfffffffcLL;
+    quint32 states[8 * MaxLanes];
+    kernel.function(hasher.midstate.data(), hasher.preState.data(), hasher.tail, firstNonce, states);
+    for (int lane = 0; lane < kernel.lanes; lane++) {
+        block.setNonce(firstNonce + lane);
+        Sha256::State state;
+        for (int i = 0; i < 8; i++)
+            state[i] = states[i * kernel.lanes + lane];
+        QByteArray digest(32, '\0');
+        Sha256::store(state, reinterpret_cast<uchar *>(digest.data()));
+        if (digest != block.calculateHash())
+            return false;
+    }
+    return true;
+}
+
+
+bool HeaderHasher::kernelFor(Backend backend, Kernel &kernel)
+{
+    switch (backend) {
+    case Scalar:
+        kernel = {Scalar, 1, &HeaderHasher::scalarKernel};
+        return true;
+#if defined(SHA256_X86_LANES) && (defined(Q_CC_GNU) || defined(Q_CC_CLANG))
+    case Sse41:
+        kernel = {Sse41, 4, &sha256LanesSse41};
+        return __builtin_cpu_supports("sse4.1");
+    case Avx2:
+        kernel = {Avx2, 8, &sha256LanesAvx2};
+        return __builtin_cpu_supports("avx2");
+    case Avx512:
+        kernel = {Avx512, 16, &sha256LanesAvx512};
+        return __builtin_cpu_supports("avx512f");
+#endif
+    default:
+        return false;
+    }
+}
+
+
+/**
+ * @brief Picks the widest kernel that the CPU supports and that passes the
+ * self test. The self test only guards against mining wrong hashes, the
+ * kernels are tested by SimpleBlockchainTests; a supported kernel failing it
+ * is reported.
+ */
+const HeaderHasher::Kernel &HeaderHasher::selectedKernel()
+{
+    static const Kernel selected = []() {
+        Kernel kernel;
+        for (auto backend : {Avx512, Avx2, Sse41}) {
+            if (!kernelFor(backend, kernel))
+                continue;
+            if (selfTest(backend))
+                return kernel;
+            qWarning("SHA-256 %s kernel failed its self test and is not used", qPrintable(getBackendName(backend)));
+        }
+        kernelFor(Scalar, kernel);
+        return kernel;
+    }();
+    return selected;
+}
+
+
+void HeaderHasher::scalarKernel(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states)
+{
+    quint32 w[64];
+    for (int i = 0; i < PreRounds; i++)
+        w[i] = tail[i];
+    w[6] = quint64(firstNonce) >> 32;
+    w[7] = quint32(firstNonce);
+    w[8] = 0x80000000;
+    for (int i = 9; i < 15; i++)
+        w[i] = 0;
+    w[15] = Block::HeaderSize * 8;
+    Sha256::expand(w);
+    Sha256::State s;
+    for (int i = 0; i < 8; i++)
+        s[i] = preState[i];
+    for (int i = PreRounds; i < 64; i++)
+        Sha256::round(s, Sha256::k[i], w[i]);
+    for (int i = 0; i < 8; i++)
+        states[i] = s[i] + midstate[i];
+}
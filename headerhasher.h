@@ -0,0 +1,61 @@
+#ifndef HEADERHASHER_H
+#define HEADERHASHER_H
+
+#include <QString>
+
+#include "block.h"
+#include "sha256.h"
+#include "sha256lanes.h"
+
+/**
+ * @brief Hashes a HeaderVersion block template for any nonce. The SHA-256
+ * state of the constant first 64 header bytes and the first rounds of the
+ * second block (which do not read the nonce) are computed once, so each
+ * nonce only costs the remaining rounds and performs no allocations.
+ * hashLanes() hashes several consecutive nonces at once with the widest
+ * SIMD kernel the CPU supports.
+ */
+class HeaderHasher
+{
+public:
+    enum Backend {
+        Scalar,
+        Sse41,
+        Avx2,
+        Avx512
+    };
+    static constexpr int MaxLanes = 16;
+
+    explicit HeaderHasher(const Block &block);
+
+    void hash(qint64 nonce, uchar *digest) const;
+    void hashLanes(qint64 firstNonce, quint32 *states) const;
+    bool hashLanes(Backend backend, qint64 firstNonce, quint32 *states, int &lanes) const;
+
+    static Backend getBackend();
+    static int getLanes();
+    static QString getBackendName();
+    static QString getBackendName(Backend backend);
+    static bool selfTest(Backend backend);
+
+private:
+    struct Kernel
+    {
+        Backend backend;
+        int lanes;
+        Sha256LaneKernel function;
+    };
+
+    static bool kernelFor(Backend backend, Kernel &kernel);
+    static const Kernel &selectedKernel();
+    static void scalarKernel(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states);
+
+private:
+    static constexpr int PreRounds = 6;
+
+    Sha256::State midstate;
+    Sha256::State preState;
+    quint32 tail[PreRounds];
+};
+
+#endif // HEADERHASHER_H
@@ -0,0 +1,147 @@
+#include "ledger.h"
+
+#include <algorithm>
+
+
+/**
+ * @brief Builds a ledger from the given blocks, stops at the first one whose
+ * hashes cannot be stored in a header.
+ */
+Ledger::Ledger(const QVector<Block> &blocks)
+{
+    for (const auto &block : blocks) {
+        if (!append(block))
+            break;
+    }
+}
+
+
+qint64 Ledger::size() const
+{
+    return count;
+}
+
+
+bool Ledger::isEmpty() const
+{
+    return count == 0;
+}
+
+
+const BlockHeader &Ledger::header(qint64 height) const
+{
+    return chunks[height / ChunkSize]->headers.at(height % ChunkSize);
+}
+
+
+const BlockHeader &Ledger::front() const
+{
+    return header(0);
+}
+
+
+const BlockHeader &Ledger::back() const
+{
+    return header(count - 1);
+}
+
+
+const QByteArray &Ledger::payload(qint64 height) const
+{
+    return chunks[height / ChunkSize]->payloads.at(height % ChunkSize);
+}
+
+
+Block Ledger::block(qint64 height) const
+{
+    return Block(header(height), payload(height));
+}
+
+
+/**
+ * @brief Full blocks from the given height on, all of them if count is negative.
+ */
+QVector<Block> Ledger::blocks(qint64 from, qint64 count) const
+{
+    auto end = count < 0 ? size() : std::min(size(), from + count);
+    QVector<Block> result;
+    result.reserve(std::max<qint64>(0, end - from));
+    for (qint64 i = from; i < end; i++)
+        result.push_back(block(i));
+    return result;
+}
+
+
+/**
+ * @brief Total work of the ledger.
+ */
+ChainWork Ledger::getWork() const
+{
+    return count == 0 ? ChainWork() : chunks.back()->work.back();
+}
+
+
+/**
+ * @brief Work of the first size blocks.
+ */
+ChainWork Ledger::getWork(qint64 size) const
+{
+    if (size <= 0)
+        return {};
+    auto height = std::min(size, count) - 1;
+    return chunks[height / ChunkSize]->work.at(height % ChunkSize);
+}
+
+
+/**
+ * @brief Adds the block on top without validating it.
+ * @return False if its hashes cannot be stored in a header
+ */
+bool Ledger::append(const Block &block)
+{
+    BlockHeader header;
+    if (!block.getHeader(header))
+        return false;
+    auto work = getWork() + ChainWork::fromDifficultySteps(header.getDifficultySteps());
+    if (count % ChunkSize == 0) {
+        auto chunk = std::make_shared<Chunk>();
+        chunk->headers.reserve(ChunkSize);
+        chunk->payloads.reserve(ChunkSize);
+        chunk->work.reserve(ChunkSize);
+        chunks.push_back(std::move(chunk));
+    } else if (chunks.back().use_count() > 1) {
+        // Shared with another ledger, which must not see the new block
+        chunks.back() = std::make_shared<Chunk>(*chunks.back());
+    }
+    auto &chunk = *chunks.back();
+    chunk.headers.push_back(header);
+    chunk.payloads.push_back(block.getData());
+    chunk.work.push_back(work);
+    count++;
+    return true;
+}
+
+
+/**
+ * @brief The first size blocks of this ledger. Full chunks are shared, only
+ * the last partial one is copied.
+ */
+Ledger Ledger::prefix(qint64 size) const
+{
+    Ledger result;
+    size = std::clamp<qint64>(size, 0, count);
+    auto full = size / ChunkSize;
+    auto rest = size % ChunkSize;
+    result.chunks.assign(chunks.begin(), chunks.begin() + full);
+    if (rest > 0) {
+        const auto &source = *chunks[full];
+        auto chunk = std::make_shared<Chunk>();
+        chunk->headers = source.headers.mid(0, rest);
+        chunk->payloads = source.payloads.mid(0, rest);
+        chunk->work = source.work.mid(0, rest);
+        result.chunks.push_back(std::move(chunk));
+    }
+    result.count = size;
+    return result;
+}
+
@@ -0,0 +1,62 @@
+#ifndef LEDGER_H
+#define LEDGER_H
+
+#include <QVector>
+
+#include <memory>
+#include <vector>
+
+#include "block.h"
+#include "chainwork.h"
+
+/**
+ * @brief Chain of blocks kept as header arrays, with the payloads stored apart
+ * so walking the chain does not touch them. The node publishes its ledger as a
+ * LedgerSnapshot with std::atomic_load/atomic_store: readers load the pointer
+ * and keep a consistent view for as long as they hold it, writers build a new
+ * Ledger and swap the pointer. These are not lock-free, the standard library
+ * guards each load and store with a short internal lock; readers never wait
+ * for a writer building its ledger, only for the pointer copy.
+ *
+ * Blocks are stored in chunks of ChunkSize that copies of a ledger share, a
+ * chunk is only copied when a shared one is written to. Copying a ledger,
+ * cutting it at a fork point and appending the new branch therefore cost
+ * O(size / ChunkSize + ChunkSize + branch length).
+ */
+class Ledger
+{
+public:
+    static constexpr qint64 ChunkSize = 1024;
+
+    Ledger() = default;
+    explicit Ledger(const QVector<Block> &blocks);
+
+    qint64 size() const;
+    bool isEmpty() const;
+    const BlockHeader &header(qint64 height) const;
+    const BlockHeader &front() const;
+    const BlockHeader &back() const;
+    const QByteArray &payload(qint64 height) const;
+    Block block(qint64 height) const;
+    QVector<Block> blocks(qint64 from = 0, qint64 count = -1) const;
+    ChainWork getWork() const;
+    ChainWork getWork(qint64 size) const;
+
+    bool append(const Block &block);
+    Ledger prefix(qint64 size) const;
+
+private:
+    struct Chunk
+    {
+        QVector<BlockHeader> headers;
+        QVector<QByteArray> payloads;
+        QVector<ChainWork> work; // Cumulative work up to and including each height
+    };
+
+    std::vector<std::shared_ptr<Chunk>> chunks;
+    qint64 count {0};
+};
+
+typedef std::shared_ptr<const Ledger> LedgerSnapshot;
+
+#endif // LEDGER_H
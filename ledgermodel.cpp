@@ -0,0 +1,85 @@
+#include "ledgermodel.h"
+#include "Constants.h"
+
+
+LedgerModel::LedgerModel(const Blockchain &blockchain, QObject *parent)
+    : QAbstractListModel{parent}
+    , blockchain(blockchain)
+{
+    connect(&frameTimer, SIGNAL(timeout()), this, SLOT(refresh()));
+    frameTimer.start(LEDGER_VIEW_FRAME_INTERVAL);
+}
+
+
+int LedgerModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : int(last - first);
+}
+
+
+QVariant LedgerModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= last - first || role != Qt::DisplayRole)
+        return {};
+    return shown->block(first + index.row()).toQString();
+}
+
+
+/**
+ * @brief Brings the rows up to date with the current ledger: the rows after
+ * the fork point are replaced and the window is trimmed to LEDGER_VIEW_ROWS.
+ */
+void LedgerModel::refresh()
+{
+    auto next = blockchain.getLedger();
+    if (next == shown)
+        return;
+    if (next->size() < first) {
+        // Replaced below the window, start over
+        beginResetModel();
+        shown = next;
+        first = std::max<qint64>(0, next->size() - LEDGER_VIEW_ROWS);
+        last = next->size();
+        endResetModel();
+        return;
+    }
+    auto common = commonHeight(*next);
+    // The removed rows are read from the old snapshot until they are gone
+    if (common < last) {
+        beginRemoveRows(QModelIndex(), common - first, last - first - 1);
+        last = common;
+        endRemoveRows();
+    }
+    // Rows before the common height are the same in both snapshots
+    shown = next;
+    if (next->size() > last) {
+        beginInsertRows(QModelIndex(), last - first, next->size() - first - 1);
+        last = next->size();
+        endInsertRows();
+    }
+    if (last - first > LEDGER_VIEW_ROWS) {
+        beginRemoveRows(QModelIndex(), 0, last - LEDGER_VIEW_ROWS - first - 1);
+        first = last - LEDGER_VIEW_ROWS;
+        endRemoveRows();
+    }
+}
+
+
+/**
+ * @brief Height of the first row that differs from the given ledger. A block
+ * hash covers its whole chain, so the rows match up to a height and differ
+ * after it, which is found by binary search.
+ */
+qint64 LedgerModel::commonHeight(const Ledger &next) const
+{
+    auto low = first;
+    auto high = std::min(last, next.size());
+    while (low < high) {
+        auto middle = low + (high - low) / 2;
+        if (shown->header(middle) == next.header(middle))
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
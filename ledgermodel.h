@@ -0,0 +1,39 @@
+#ifndef LEDGERMODEL_H
+#define LEDGERMODEL_H
+
+#include <QAbstractListModel>
+#include <QTimer>
+
+#include "blockchain.h"
+
+/**
+ * @brief List model of the last LEDGER_VIEW_ROWS blocks of the ledger. The
+ * ledger snapshot is polled every LEDGER_VIEW_FRAME_INTERVAL, so any number of
+ * new blocks or a reorg between two frames is one row update, and nothing is
+ * sent from the miner or validation threads. Rows are formatted when the view
+ * asks for them, which is only for the visible ones.
+ */
+class LedgerModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit LedgerModel(const Blockchain &blockchain, QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const override;
+
+private slots:
+    void refresh();
+
+private:
+    qint64 commonHeight(const Ledger &next) const;
+
+private:
+    const Blockchain &blockchain;
+    LedgerSnapshot shown {std::make_shared<const Ledger>()};
+    qint64 first {0};   // Height of the first row
+    qint64 last {0};    // Height after the last row
+    QTimer frameTimer;
+};
+
+#endif // LEDGERMODEL_H
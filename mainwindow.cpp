@@ -5,9 +5,12 @@ MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
     , ui(new Ui::MainWindow)
     , blockchain(Blockchain(this))
+    , ledgerModel(blockchain)
 {
     ui->setupUi(this);
-    connect(&blockchain, SIGNAL(blockMined(const Block &, QColor)), this, SLOT(onBlockMined(const Block &, QColor)));
+    // Mined and received blocks are both read from the ledger, blockMined is not needed
+    ui->ledgerList->setModel(&ledgerModel);
+    connect(&ledgerModel, &LedgerModel::rowsInserted, ui->ledgerList, &QListView::scrollToBottom);
     connect(&blockchain, SIGNAL(messageSent(QString, QColor)), this, SLOT(onMessageSent(QString, QColor)));
     connect(&blockchain, SIGNAL(updateAverage(qint64)), this, SLOT(onUpdateAverage(qint64)));
     connect(&blockchain, SIGNAL(update10Average(qint64)), this, SLOT(onUpdate10Average(qint64)));
@@ -24,11 +27,11 @@ void MainWindow::on_connectButton_clicked()
 {
     auto port = blockchain.startServer();
     if (port == 0) {
-        printLedger("Server could not start on port " + QByteArray::number(port));
+        printMessage("Server could not start on port " + QByteArray::number(port));
     } else if (port == -1) {
         return;
     } else {
-        printLedger("Server started on port " + QByteArray::number(port));
+        printMessage("Server started on port " + QByteArray::number(port));
         changeStatus("Online 127.0.0.1:" + QString::number(port));
     }
 }
@@ -36,6 +39,10 @@ void MainWindow::on_connectButton_clicked()
 
 void MainWindow::on_mineButton_clicked()
 {
+    // Named nodes keep their ledger on disk and resume from it
+    auto name = ui->nodeNameLineEdit->text().trimmed();
+    if (!name.isEmpty())
+        blockchain.openStore(QDir(QStandardPaths::writableLocation(QStandardPaths::AppDataLocation)).filePath(name));
     auto thread = QThread::create([this](){
         blockchain.startMining();
     });
@@ -45,33 +52,22 @@ void MainWindow::on_mineButton_clicked()
 
 void MainWindow::on_connectPortButton_clicked()
 {
-    bool ok;
-    auto port = ui->connectPortLineEdit->text().toInt(&ok, 10);
-    if (!ok) {
+    // Either a port on DEFAULT_PEER_HOST or host:port, the connection is made in the background
+    QString host;
+    quint16 port;
+    if (!PeerManager::parseAddress(ui->connectPortLineEdit->text(), host, port)) {
         QMessageBox msgBox;
-        msgBox.setText("Error when converting port to number!");
+        msgBox.setText("Error when reading the peer address, expected port or host:port!");
         msgBox.exec();
         return;
     }
-    auto res = blockchain.connectToPort(port);
-    if (!res) {
-        QMessageBox msgBox;
-        msgBox.setText("Error when connecting to port: " + QString::number(port));
-        msgBox.exec();
-        return;
-    }
-}
-
-
-void MainWindow::onBlockMined(const Block &block, QColor color)
-{
-    printLedger(block.toQString().toUtf8(), color);
+    blockchain.connectToPeer(host, port);
 }
 
 
 void MainWindow::onMessageSent(QString message, QColor color)
 {
-    printLedger(message.toUtf8(), color);
+    printMessage(message.toUtf8(), color);
 }
 
 void MainWindow::changeStatus(QString message)
@@ -91,25 +87,17 @@ void MainWindow::onUpdate10Average(qint64 milis)
 
 void MainWindow::onDifficultyChnaged(qint64 diff)
 {
-    ui->diffInfoLabel->setText(QString::number(diff));
+    ui->diffInfoLabel->setText(QString::number(diff / double(ChainWork::StepsPerBit), 'f', 2));
 }
 
 
-void MainWindow::printLedger(QByteArray message, QColor color)
+void MainWindow::printMessage(QByteArray message, QColor color)
 {
     auto item = new QListWidgetItem();
     item->setText(message);
     item->setForeground(color);
-    ui->ledgerList->addItem(item);
-    ui->ledgerList->scrollToBottom();
-}
-
-
-void MainWindow::printHash(QByteArray hash, QColor color)
-{
-    auto item = new QListWidgetItem();
-    item->setText(hash);
-    item->setForeground(color);
-    ui->hashesList->addItem(item);
-    ui->hashesList->scrollToBottom();
+    ui->messagesList->addItem(item);
+    if (ui->messagesList->count() > MESSAGE_LOG_ROWS)
+        delete ui->messagesList->takeItem(0);
+    ui->messagesList->scrollToBottom();
 }
@@ -5,8 +5,11 @@
 #include <QMessageBox>
 #include <QThread>
 #include <QColor>
+#include <QDir>
+#include <QStandardPaths>
 
 #include "blockchain.h"
+#include "ledgermodel.h"
 
 QT_BEGIN_NAMESPACE
 namespace Ui { class MainWindow; }
@@ -27,8 +30,6 @@ private slots:
 
     void on_connectPortButton_clicked();
 
-    void onBlockMined(const Block &block, QColor color);
-
     void onMessageSent(QString message, QColor color);
 
     void changeStatus(QString message);
@@ -41,12 +42,11 @@ private slots:
 
 private:
 
-    void printLedger(QByteArray message, QColor color = QColor(Qt::black));
-
-    void printHash(QByteArray hash, QColor color = QColor(Qt::black));
+    void printMessage(QByteArray message, QColor color = QColor(Qt::black));
 
 private:
     Ui::MainWindow *ui;
     Blockchain blockchain;
+    LedgerModel ledgerModel;
 };
 #endif // MAINWINDOW_H
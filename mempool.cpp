@@ -0,0 +1,142 @@
+#include "mempool.h"
+#include "Constants.h"
+
+#include <iterator>
+
+
+Mempool::Mempool(qint64 maxBytes)
+    : maxBytes(maxBytes)
+{
+
+}
+
+
+/**
+ * @return False if the transaction is known, was confirmed recently, is too
+ * large, or has too low a fee to stay in a full pool
+ */
+bool Mempool::add(const Transaction &transaction)
+{
+    QMutexLocker locker(&mutex);
+    if (confirmed.contains(transaction.getHash()))
+        return false;
+    return insert(transaction);
+}
+
+
+bool Mempool::contains(const QByteArray &hash) const
+{
+    QMutexLocker locker(&mutex);
+    return entries.contains(hash);
+}
+
+
+/**
+ * @brief Removes transactions that went into the best chain.
+ */
+void Mempool::confirm(const QVector<Transaction> &transactions)
+{
+    QMutexLocker locker(&mutex);
+    for (const auto &transaction : transactions) {
+        erase(transaction.getHash());
+        if (confirmed.contains(transaction.getHash()))
+            continue;
+        confirmed.insert(transaction.getHash(), true);
+        confirmedOrder.enqueue(transaction.getHash());
+        if (confirmedOrder.size() > MEMPOOL_CONFIRMED_CACHE)
+            confirmed.remove(confirmedOrder.dequeue());
+    }
+}
+
+
+/**
+ * @brief Takes back transactions of blocks a reorg removed from the best chain.
+ */
+void Mempool::unconfirm(const QVector<Transaction> &transactions)
+{
+    QMutexLocker locker(&mutex);
+    for (const auto &transaction : transactions) {
+        // Left in confirmedOrder, if confirmed again it is forgotten a bit early
+        confirmed.remove(transaction.getHash());
+        insert(transaction);
+    }
+}
+
+
+/**
+ * @brief Picks the best transactions for a block, in priority order. Ones too
+ * large for the remaining space are skipped for smaller ones after them.
+ */
+QVector<Transaction> Mempool::assemble(qint64 maxBytes) const
+{
+    QMutexLocker locker(&mutex);
+    QVector<Transaction> transactions;
+    for (auto it = byPriority.cbegin(); it != byPriority.cend() && maxBytes > 0; ++it) {
+        const auto &transaction = entries.constFind(it->second)->transaction;
+        if (transaction.getSize() > maxBytes)
+            continue;
+        transactions.push_back(transaction);
+        maxBytes -= transaction.getSize();
+    }
+    return transactions;
+}
+
+
+qsizetype Mempool::size() const
+{
+    QMutexLocker locker(&mutex);
+    return entries.size();
+}
+
+
+qint64 Mempool::bytes() const
+{
+    QMutexLocker locker(&mutex);
+    return totalBytes;
+}
+
+
+bool Mempool::Priority::operator<(const Priority &other) const
+{
+    if (feeRate != other.feeRate)
+        return feeRate > other.feeRate;
+    return sequence < other.sequence;
+}
+
+
+/**
+ * @brief Adds the transaction and evicts the lowest priority ones while the
+ * pool is over its limit. The caller holds the mutex.
+ * @return False if the transaction is known, too large or was evicted itself
+ */
+bool Mempool::insert(const Transaction &transaction)
+{
+    const auto &hash = transaction.getHash();
+    if (entries.contains(hash) || transaction.getSize() > maxBytes)
+        return false;
+    Entry entry {transaction, {transaction.getFeeRate(), nextSequence++}};
+    byPriority.emplace(entry.priority, hash);
+    entries.insert(hash, entry);
+    totalBytes += transaction.getSize();
+    auto evictedSelf = false;
+    while (totalBytes > maxBytes) {
+        auto worst = std::prev(byPriority.end())->second;
+        evictedSelf |= worst == hash;
+        erase(worst);
+    }
+    return !evictedSelf;
+}
+
+
+/**
+ * @brief Removes the transaction if pending. The caller holds the mutex.
+ */
+void Mempool::erase(const QByteArray &hash)
+{
+    auto it = entries.find(hash);
+    if (it == entries.end())
+        return;
+    byPriority.erase(it->priority);
+    totalBytes -= it->transaction.getSize();
+    entries.erase(it);
+}
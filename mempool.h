@@ -0,0 +1,61 @@
+#ifndef MEMPOOL_H
+#define MEMPOOL_H
+
+#include <QHash>
+#include <QMutex>
+#include <QQueue>
+
+#include <map>
+
+#include "transaction.h"
+
+/**
+ * @brief Pending transactions, indexed by hash and by priority. Priority is
+ * the fee per byte, earlier arrivals first on equal rates. When the pool is
+ * over its byte limit the lowest priority transactions are evicted. Hashes of
+ * recently confirmed transactions are remembered, so a peer relaying one late
+ * does not bring it back. All methods are thread-safe.
+ */
+class Mempool
+{
+public:
+    explicit Mempool(qint64 maxBytes);
+
+    bool add(const Transaction &transaction);
+    bool contains(const QByteArray &hash) const;
+    void confirm(const QVector<Transaction> &transactions);
+    void unconfirm(const QVector<Transaction> &transactions);
+    QVector<Transaction> assemble(qint64 maxBytes) const;
+    qsizetype size() const;
+    qint64 bytes() const;
+
+private:
+    struct Priority
+    {
+        double feeRate;
+        quint64 sequence;
+
+        bool operator<(const Priority &other) const;
+    };
+
+    struct Entry
+    {
+        Transaction transaction;
+        Priority priority;
+    };
+
+    bool insert(const Transaction &transaction);
+    void erase(const QByteArray &hash);
+
+private:
+    mutable QMutex mutex;
+    QHash<QByteArray, Entry> entries;
+    std::map<Priority, QByteArray> byPriority; // Best first, values are hashes
+    QHash<QByteArray, bool> confirmed;
+    QQueue<QByteArray> confirmedOrder;      // Oldest first, for eviction
+    qint64 maxBytes;
+    qint64 totalBytes {0};
+    quint64 nextSequence {0};
+};
+
+#endif // MEMPOOL_H
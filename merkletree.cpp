@@ -0,0 +1,99 @@
+#include "merkletree.h"
+
+#include <QCryptographicHash>
+
+
+QByteArray MerkleTree::root(const QVector<QByteArray> &hashes)
+{
+    if (hashes.isEmpty())
+        return QByteArray(32, '\0');
+    QVector<QByteArray> level;
+    level.reserve(hashes.size());
+    for (const auto &hash : hashes)
+        level.push_back(leaf(hash));
+    while (level.size() > 1)
+        level = parentLevel(level);
+    return level.front();
+}
+
+
+/**
+ * @brief Siblings on the path from the leaf at the position to the root,
+ * bottom up. Levels where the node is carried up have no sibling.
+ * @return Empty if the position is out of range or there is only one leaf
+ */
+QVector<QByteArray> MerkleTree::proof(const QVector<QByteArray> &hashes, qsizetype position)
+{
+    QVector<QByteArray> path;
+    if (position < 0 || position >= hashes.size())
+        return path;
+    QVector<QByteArray> level;
+    level.reserve(hashes.size());
+    for (const auto &hash : hashes)
+        level.push_back(leaf(hash));
+    while (level.size() > 1) {
+        auto sibling = position ^ 1;
+        if (sibling < level.size())
+            path.push_back(level[sibling]);
+        level = parentLevel(level);
+        position /= 2;
+    }
+    return path;
+}
+
+
+/**
+ * @brief Root of a tree of the given leaf count that has the hash at the
+ * position, in O(log count). Empty if the proof does not fit the tree shape.
+ */
+QByteArray MerkleTree::rootFromProof(const QByteArray &hash, qsizetype position, qsizetype count, const QVector<QByteArray> &proof)
+{
+    if (position < 0 || position >= count)
+        return {};
+    auto current = leaf(hash);
+    qsizetype used = 0;
+    for (auto size = count; size > 1; size = (size + 1) / 2) {
+        auto sibling = position ^ 1;
+        if (sibling < size) {
+            if (used == proof.size())
+                return {};
+            const auto &other = proof[used++];
+            current = position & 1 ? node(other, current) : node(current, other);
+        }
+        position /= 2;
+    }
+    if (used != proof.size())
+        return {};
+    return current;
+}
+
+
+QByteArray MerkleTree::leaf(const QByteArray &hash)
+{
+    QCryptographicHash sha(QCryptographicHash::Sha256);
+    sha.addData(QByteArray(1, '\0'));
+    sha.addData(hash);
+    return sha.result();
+}
+
+
+QByteArray MerkleTree::node(const QByteArray &left, const QByteArray &right)
+{
+    QCryptographicHash sha(QCryptographicHash::Sha256);
+    sha.addData(QByteArray(1, '\1'));
+    sha.addData(left);
+    sha.addData(right);
+    return sha.result();
+}
+
+
+QVector<QByteArray> MerkleTree::parentLevel(const QVector<QByteArray> &level)
+{
+    QVector<QByteArray> parents;
+    parents.reserve((level.size() + 1) / 2);
+    for (qsizetype i = 0; i + 1 < level.size(); i += 2)
+        parents.push_back(node(level[i], level[i + 1]));
+    if (level.size() % 2)
+        parents.push_back(level.back());
+    return parents;
+}
@@ -0,0 +1,28 @@
+#ifndef MERKLETREE_H
+#define MERKLETREE_H
+
+#include <QByteArray>
+#include <QVector>
+
+/**
+ * @brief Binary Merkle tree over transaction hashes. Leaves are
+ * SHA-256(0x00 || hash) and inner nodes SHA-256(0x01 || left || right), so a
+ * leaf can not pass for an inner node. The last node of a level with an odd
+ * count is carried up unchanged instead of being paired with itself, which
+ * keeps one root per transaction list. The root of an empty list is 32 zero
+ * bytes.
+ */
+class MerkleTree
+{
+public:
+    static QByteArray root(const QVector<QByteArray> &hashes);
+    static QVector<QByteArray> proof(const QVector<QByteArray> &hashes, qsizetype position);
+    static QByteArray rootFromProof(const QByteArray &hash, qsizetype position, qsizetype count, const QVector<QByteArray> &proof);
+
+private:
+    static QByteArray leaf(const QByteArray &hash);
+    static QByteArray node(const QByteArray &left, const QByteArray &right);
+    static QVector<QByteArray> parentLevel(const QVector<QByteArray> &level);
+};
+
+#endif // MERKLETREE_H
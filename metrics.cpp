@@ -0,0 +1,165 @@
+#include "metrics.h"
+
+#include <algorithm>
+#include <cmath>
+
+
+void Metrics::Counter::add(quint64 value)
+{
+    count.fetch_add(value, std::memory_order_relaxed);
+}
+
+
+quint64 Metrics::Counter::value() const
+{
+    return count.load(std::memory_order_relaxed);
+}
+
+
+void Metrics::Gauge::set(qint64 value)
+{
+    current.store(value, std::memory_order_relaxed);
+}
+
+
+void Metrics::Gauge::add(qint64 value)
+{
+    current.fetch_add(value, std::memory_order_relaxed);
+}
+
+
+qint64 Metrics::Gauge::value() const
+{
+    return current.load(std::memory_order_relaxed);
+}
+
+
+Metrics::Histogram::Histogram(const QVector<double> &bounds)
+    : bounds(bounds)
+    , buckets(new std::atomic<quint64>[bounds.size() + 1])
+{
+    std::sort(this->bounds.begin(), this->bounds.end());
+    for (qsizetype i = 0; i <= bounds.size(); i++)
+        buckets[i].store(0, std::memory_order_relaxed);
+}
+
+
+void Metrics::Histogram::observe(double value)
+{
+    // Only the first bucket holding the value is counted, render() sums them up
+    auto bucket = std::lower_bound(bounds.cbegin(), bounds.cend(), value) - bounds.cbegin();
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    auto current = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {}
+}
+
+
+quint64 Metrics::Histogram::observations() const
+{
+    quint64 count = 0;
+    for (qsizetype i = 0; i <= bounds.size(); i++)
+        count += buckets[i].load(std::memory_order_relaxed);
+    return count;
+}
+
+
+/**
+ * @brief Sum of all observed values.
+ */
+double Metrics::Histogram::total() const
+{
+    return sum.load(std::memory_order_relaxed);
+}
+
+
+Metrics::Counter &Metrics::counter(const QByteArray &name, const QByteArray &help)
+{
+    auto &entry = add(CounterType, name, help);
+    entry.counter = std::make_unique<Counter>();
+    return *entry.counter;
+}
+
+
+/**
+ * @brief Registers a counter kept elsewhere, the sampler returns its current value.
+ */
+void Metrics::counter(const QByteArray &name, const QByteArray &help, Sampler sampler)
+{
+    add(CounterType, name, help).sampler = std::move(sampler);
+}
+
+
+Metrics::Gauge &Metrics::gauge(const QByteArray &name, const QByteArray &help)
+{
+    auto &entry = add(GaugeType, name, help);
+    entry.gauge = std::make_unique<Gauge>();
+    return *entry.gauge;
+}
+
+
+/**
+ * @brief Registers a gauge computed when rendering, the sampler returns its current value.
+ */
+void Metrics::gauge(const QByteArray &name, const QByteArray &help, Sampler sampler)
+{
+    add(GaugeType, name, help).sampler = std::move(sampler);
+}
+
+
+Metrics::Histogram &Metrics::histogram(const QByteArray &name, const QByteArray &help, const QVector<double> &bounds)
+{
+    auto &entry = add(HistogramType, name, help);
+    entry.histogram = std::make_unique<Histogram>(bounds);
+    return *entry.histogram;
+}
+
+
+Metrics::Entry &Metrics::add(Type type, const QByteArray &name, const QByteArray &help)
+{
+    entries.push_back(Entry {type, name, help, nullptr, nullptr, nullptr, nullptr});
+    return entries.back();
+}
+
+
+/**
+ * @brief All metrics in the Prometheus text exposition format, version 0.0.4.
+ */
+QByteArray Metrics::render() const
+{
+    static const char *typeNames[] = {"counter", "gauge", "histogram"};
+    QByteArray text;
+    for (const auto &entry : entries) {
+        text += "# HELP " + entry.name + " " + entry.help + "\n";
+        text += "# TYPE " + entry.name + " " + typeNames[entry.type] + "\n";
+        if (entry.sampler) {
+            text += entry.name + " " + number(entry.sampler()) + "\n";
+        } else if (entry.counter) {
+            text += entry.name + " " + QByteArray::number(entry.counter->value()) + "\n";
+        } else if (entry.gauge) {
+            text += entry.name + " " + QByteArray::number(entry.gauge->value()) + "\n";
+        } else if (entry.histogram) {
+            const auto &histogram = *entry.histogram;
+            quint64 cumulative = 0;
+            for (qsizetype i = 0; i < histogram.bounds.size(); i++) {
+                cumulative += histogram.buckets[i].load(std::memory_order_relaxed);
+                text += entry.name + "_bucket{le=\"" + number(histogram.bounds[i]) + "\"} " + QByteArray::number(cumulative) + "\n";
+            }
+            cumulative += histogram.buckets[histogram.bounds.size()].load(std::memory_order_relaxed);
+            text += entry.name + "_bucket{le=\"+Inf\"} " + QByteArray::number(cumulative) + "\n";
+            text += entry.name + "_sum " + number(histogram.sum.load(std::memory_order_relaxed)) + "\n";
+            // Taken from the buckets, so the count always matches the +Inf bucket
+            text += entry.name + "_count " + QByteArray::number(cumulative) + "\n";
+        }
+    }
+    return text;
+}
+
+
+QByteArray Metrics::number(double value)
+{
+    if (std::isinf(value))
+        return value > 0 ? "+Inf" : "-Inf";
+    if (std::isnan(value))
+        return "NaN";
+    return QByteArray::number(value, 'g', 15);
+}
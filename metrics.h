@@ -0,0 +1,93 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Registry of node metrics, rendered in the Prometheus text format.
+ * Updating a counter, gauge or histogram is a relaxed atomic operation, so
+ * any thread may do it without locking. Metrics are registered once, before
+ * the threads that update them start; sampled metrics are read by calling
+ * their function while rendering, on the rendering thread.
+ */
+class Metrics
+{
+public:
+    class Counter
+    {
+    public:
+        void add(quint64 value = 1);
+        quint64 value() const;
+
+    private:
+        std::atomic<quint64> count {0};
+    };
+
+    class Gauge
+    {
+    public:
+        void set(qint64 value);
+        void add(qint64 value);
+        qint64 value() const;
+
+    private:
+        std::atomic<qint64> current {0};
+    };
+
+    /**
+     * @brief Counts observations in cumulative buckets, each bucket holds the
+     * observations up to its upper bound.
+     */
+    class Histogram
+    {
+    public:
+        explicit Histogram(const QVector<double> &bounds);
+
+        void observe(double value);
+        quint64 observations() const;
+        double total() const;
+
+    private:
+        friend class Metrics;
+        QVector<double> bounds;
+        std::unique_ptr<std::atomic<quint64>[]> buckets; // One per bound, then +Inf
+        std::atomic<double> sum {0};
+    };
+
+    typedef std::function<double()> Sampler;
+
+    Counter &counter(const QByteArray &name, const QByteArray &help);
+    void counter(const QByteArray &name, const QByteArray &help, Sampler sampler);
+    Gauge &gauge(const QByteArray &name, const QByteArray &help);
+    void gauge(const QByteArray &name, const QByteArray &help, Sampler sampler);
+    Histogram &histogram(const QByteArray &name, const QByteArray &help, const QVector<double> &bounds);
+
+    QByteArray render() const;
+
+private:
+    enum Type { CounterType, GaugeType, HistogramType };
+
+    struct Entry
+    {
+        Type type;
+        QByteArray name;
+        QByteArray help;
+        std::unique_ptr<Counter> counter;
+        std::unique_ptr<Gauge> gauge;
+        std::unique_ptr<Histogram> histogram;
+        Sampler sampler;
+    };
+
+    Entry &add(Type type, const QByteArray &name, const QByteArray &help);
+    static QByteArray number(double value);
+
+    std::vector<Entry> entries;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,69 @@
+#include "metricsserver.h"
+#include "Constants.h"
+
+#include <QTimer>
+
+
+MetricsServer::MetricsServer(const Metrics &metrics, QObject *parent)
+    : QObject{parent}
+    , metrics(metrics)
+{
+    connect(&server, SIGNAL(newConnection()), this, SLOT(onNewConnection()));
+}
+
+
+/**
+ * @return The port listened on, -1 if it could not listen
+ */
+qint32 MetricsServer::listen(const QHostAddress &address, quint16 port)
+{
+    if (!server.listen(address, port))
+        return -1;
+    return server.serverPort();
+}
+
+
+void MetricsServer::onNewConnection()
+{
+    while (auto socket = server.nextPendingConnection()) {
+        connect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+        connect(socket, SIGNAL(disconnected()), socket, SLOT(deleteLater()));
+        // Scrapers send their request right away, idle connections are dropped
+        QTimer::singleShot(WAIT_TIME, socket, [socket]() {
+            socket->abort();
+        });
+    }
+}
+
+
+void MetricsServer::onReadyRead()
+{
+    auto *socket = reinterpret_cast<QTcpSocket *>(sender());
+    if (!socket->canReadLine()) {
+        if (socket->bytesAvailable() > METRICS_MAX_REQUEST)
+            socket->abort();
+        return;
+    }
+    // Only the request line matters, the headers are discarded
+    auto request = socket->readLine(METRICS_MAX_REQUEST).trimmed().split(' ');
+    socket->readAll();
+    disconnect(socket, SIGNAL(readyRead()), this, SLOT(onReadyRead()));
+    if (request.size() < 2 || request[0] != "GET")
+        reply(socket, "405 Method Not Allowed", QByteArray());
+    else if (request[1] != "/metrics")
+        reply(socket, "404 Not Found", QByteArray());
+    else
+        reply(socket, "200 OK", metrics.render());
+}
+
+
+void MetricsServer::reply(QTcpSocket *socket, const QByteArray &status, const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.0 " + status + "\r\n";
+    response += "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+    response += "Content-Length: " + QByteArray::number(body.size()) + "\r\n";
+    response += "Connection: close\r\n\r\n";
+    response += body;
+    socket->write(response);
+    socket->disconnectFromHost();
+}
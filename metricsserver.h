@@ -0,0 +1,35 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+#include "metrics.h"
+
+/**
+ * @brief Minimal HTTP/1.0 server answering GET /metrics with the rendered
+ * metrics, so a headless node can be scraped. Each connection serves one
+ * request and is closed.
+ */
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MetricsServer(const Metrics &metrics, QObject *parent = nullptr);
+
+    qint32 listen(const QHostAddress &address, quint16 port);
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    void reply(QTcpSocket *socket, const QByteArray &status, const QByteArray &body);
+
+private:
+    const Metrics &metrics;
+    QTcpServer server;
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,157 @@
+#include "miner.h"
+#include "headerhasher.h"
+#include "Constants.h"
+
+#include <QThread>
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+
+Miner::Miner(const std::atomic<bool> &abort, int threadCount)
+    : abort(abort)
+{
+    setThreadCount(threadCount);
+}
+
+
+int Miner::getThreadCount() const
+{
+    return threadCount;
+}
+
+
+/**
+ * @brief Sets the number of worker threads, 0 or less picks one per core.
+ */
+void Miner::setThreadCount(int newThreadCount)
+{
+    if (newThreadCount <= 0)
+        newThreadCount = std::max(1, QThread::idealThreadCount());
+    threadCount = newThreadCount;
+}
+
+
+/**
+ * @brief Hashes computed by all workers so far, updated every HASH_COUNT_INTERVAL hashes per worker.
+ */
+quint64 Miner::getHashCount() const
+{
+    return hashCount.load(std::memory_order_relaxed);
+}
+
+
+/**
+ * @brief Searches for a nonce for the given block. Only the nonce and hash of
+ * the block are changed.
+ * @return True if a valid nonce was found, false if mining was aborted
+ */
+bool Miner::mine(Block &block)
+{
+    found = false;
+    const qint64 span = std::numeric_limits<qint64>::max() / threadCount;
+    std::vector<QThread *> workers;
+    workers.reserve(threadCount);
+    for (int i = 0; i < threadCount; i++) {
+        qint64 first = span * i;
+        qint64 last = (i == threadCount - 1) ? std::numeric_limits<qint64>::max() : first + span;
+        workers.push_back(QThread::create([this, block, first, last]() {
+            work(block, first, last);
+        }));
+        workers.back()->start();
+    }
+    for (auto *worker : workers) {
+        worker->wait();
+        delete worker;
+    }
+    if (!found)
+        return false;
+    block.setNonce(result.getNonce());
+    block.setHash(result.getHash());
+    return true;
+}
+
+
+void Miner::work(Block block, qint64 first, qint64 last)
+{
+    qint64 counted = first;
+    qint64 end;
+    if (block.getVersion() == Block::LegacyVersion)
+        end = searchLegacy(block, first, last, counted);
+    else
+        end = searchHeader(block, first, last, counted);
+    hashCount.fetch_add(end - counted, std::memory_order_relaxed);
+}
+
+
+/**
+ * @param counted Nonce up to which the hashes were added to the hash count, advanced while searching
+ * @return The nonce after the last one tried
+ */
+qint64 Miner::searchLegacy(Block &block, qint64 first, qint64 last, qint64 &counted)
+{
+    for (qint64 nonce = first; nonce < last; nonce++) {
+        if (found.load(std::memory_order_relaxed) || abort.load(std::memory_order_relaxed))
+            return nonce;
+        if (nonce - counted >= HASH_COUNT_INTERVAL) {
+            hashCount.fetch_add(nonce - counted, std::memory_order_relaxed);
+            counted = nonce;
+        }
+        block.setNonce(nonce);
+        auto hash = block.calculateHash();
+        if (Block::meetsDifficulty(reinterpret_cast<const uchar *>(hash.constData()), block.getDifficultySteps())) {
+            block.setHash(hash);
+            publish(block);
+            return nonce + 1;
+        }
+    }
+    return last;
+}
+
+
+/**
+ * @param counted Nonce up to which the hashes were added to the hash count, advanced while searching
+ * @return The nonce after the last one tried
+ */
+qint64 Miner::searchHeader(Block &block, qint64 first, qint64 last, qint64 &counted)
+{
+    HeaderHasher hasher(block);
+    const int lanes = HeaderHasher::getLanes();
+    const auto steps = block.getDifficultySteps();
+    // Leading zeros are checked on the raw state, the few hashes passing get the full check
+    const auto zeros = std::max(0, steps / ChainWork::StepsPerBit);
+    quint32 states[8 * HeaderHasher::MaxLanes];
+    for (qint64 nonce = first; nonce < last; nonce += lanes) {
+        if (found.load(std::memory_order_relaxed) || abort.load(std::memory_order_relaxed))
+            return nonce;
+        if (nonce - counted >= HASH_COUNT_INTERVAL) {
+            hashCount.fetch_add(nonce - counted, std::memory_order_relaxed);
+            counted = nonce;
+        }
+        hasher.hashLanes(nonce, states);
+        for (int lane = 0; lane < lanes && lane < last - nonce; lane++) {
+            if (Block::getHashDiff(states + lane, lanes) >= zeros) {
+                uchar digest[32];
+                hasher.hash(nonce + lane, digest);
+                if (!Block::meetsDifficulty(digest, steps))
+                    continue;
+                block.setNonce(nonce + lane);
+                block.setHash(QByteArray(reinterpret_cast<const char *>(digest), sizeof(digest)));
+                publish(block);
+                return nonce + lane + 1;
+            }
+        }
+    }
+    return last;
+}
+
+
+void Miner::publish(const Block &block)
+{
+    QMutexLocker locker(&resultMutex);
+    if (found)
+        return;
+    result = block;
+    found = true;
+}
@@ -0,0 +1,41 @@
+#ifndef MINER_H
+#define MINER_H
+
+#include <QMutex>
+
+#include <atomic>
+
+#include "block.h"
+
+/**
+ * @brief Parallel proof-of-work search. The nonce space is split into disjoint
+ * ranges, one per worker thread; the first worker to find a hash meeting the
+ * block difficulty stops the others.
+ */
+class Miner
+{
+public:
+    Miner(const std::atomic<bool> &abort, int threadCount = 0);
+
+    int getThreadCount() const;
+    void setThreadCount(int newThreadCount);
+    quint64 getHashCount() const;
+
+    bool mine(Block &block);
+
+private:
+    void work(Block block, qint64 first, qint64 last);
+    qint64 searchLegacy(Block &block, qint64 first, qint64 last, qint64 &counted);
+    qint64 searchHeader(Block &block, qint64 first, qint64 last, qint64 &counted);
+    void publish(const Block &block);
+
+private:
+    const std::atomic<bool> &abort;
+    std::atomic<bool> found {false};
+    std::atomic<quint64> hashCount {0};
+    QMutex resultMutex;
+    Block result;
+    int threadCount;
+};
+
+#endif // MINER_H
@@ -0,0 +1,143 @@
+#include "blockchain.h"
+#include "metricsserver.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QThread>
+
+#include <iostream>
+
+#ifdef Q_OS_UNIX
+#include <QSocketNotifier>
+
+#include <csignal>
+#include <sys/socket.h>
+#include <unistd.h>
+
+static int signalSockets[2] = {-1, -1}; // Written by the signal handler, read by the event loop
+
+
+static void onQuitSignal(int)
+{
+    // Only async-signal-safe calls here, the event loop does the rest
+    char byte = 1;
+    [[maybe_unused]] auto written = ::write(signalSockets[0], &byte, 1);
+}
+
+
+/**
+ * @brief Routes SIGINT and SIGTERM to QCoreApplication::quit() through a
+ * socket pair, so Ctrl-C or kill stops the miner and syncs the block store
+ * like a normal exit.
+ */
+static bool quitOnSignals(QCoreApplication &app)
+{
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalSockets) != 0)
+        return false;
+    auto *notifier = new QSocketNotifier(signalSockets[1], QSocketNotifier::Read, &app);
+    QObject::connect(notifier, &QSocketNotifier::activated, &app, [notifier]() {
+        notifier->setEnabled(false);
+        // A second signal kills the node if shutting down hangs
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        char byte;
+        [[maybe_unused]] auto read = ::read(signalSockets[1], &byte, 1);
+        QCoreApplication::quit();
+    });
+    struct sigaction action {};
+    action.sa_handler = onQuitSignal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    return sigaction(SIGINT, &action, nullptr) == 0 && sigaction(SIGTERM, &action, nullptr) == 0;
+}
+#endif
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("SimpleBlockchainNode");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Headless Simple Blockchain node");
+    parser.addHelpOption();
+    QCommandLineOption portOption("port", "Port to accept peers on, 0 picks a free one.", "port", "0");
+    QCommandLineOption peerOption("peer", "Peer to follow, as port or host:port. Can be given several times.", "peer");
+    QCommandLineOption threadsOption("threads", "Mining threads, 0 uses one per core.", "count", QString::number(DEFAULT_MINER_THREADS));
+    QCommandLineOption dataDirOption("datadir", "Directory of the block store, the ledger is kept in memory only if not set.", "dir");
+    QCommandLineOption noMineOption("no-mine", "Only relay blocks, do not mine.");
+    QCommandLineOption metricsOption("metrics", "Serve Prometheus metrics on http://address/metrics, given as port or host:port.", "address");
+    QCommandLineOption retargetOption("retarget", "Difficulty retarget policy, proportional or step.", "policy", "proportional");
+    parser.addOptions({portOption, peerOption, threadsOption, dataDirOption, noMineOption, metricsOption, retargetOption});
+    parser.process(a);
+#ifdef Q_OS_UNIX
+    if (!quitOnSignals(a))
+        std::cerr << "Could not handle SIGINT and SIGTERM, the block store is only synced on a normal exit" << std::endl;
+#endif
+
+    Blockchain blockchain;
+    QObject::connect(&blockchain, &Blockchain::messageSent, [](QString message, QColor) {
+        std::cout << message.toStdString() << std::endl;
+    });
+    QObject::connect(&blockchain, &Blockchain::blockMined, [](const Block &block, QColor) {
+        std::cout << "Block " << block.getIndex() << " " << Block::getHashString(block.getHash()).toStdString() << std::endl;
+    });
+
+    if (parser.isSet(dataDirOption) && !blockchain.openStore(parser.value(dataDirOption)))
+        return 1;
+    blockchain.setMinerThreads(parser.value(threadsOption).toInt());
+    if (parser.value(retargetOption) == "step") {
+        blockchain.setDifficultyPolicy(std::make_shared<StepPolicy>());
+    } else if (parser.value(retargetOption) != "proportional") {
+        std::cerr << "Unknown retarget policy " << parser.value(retargetOption).toStdString() << std::endl;
+        return 1;
+    }
+
+    auto port = blockchain.startServer(parser.value(portOption).toUShort());
+    if (port <= 0)
+        return 1;
+    std::cout << "Listening on port " << port << std::endl;
+
+    MetricsServer metricsServer(blockchain.getMetrics());
+    if (parser.isSet(metricsOption)) {
+        QString host;
+        quint16 metricsPort;
+        QHostAddress address;
+        if (!PeerManager::parseAddress(parser.value(metricsOption), host, metricsPort) || !address.setAddress(host)) {
+            std::cerr << "Invalid metrics address " << parser.value(metricsOption).toStdString() << std::endl;
+            return 1;
+        }
+        if (metricsServer.listen(address, metricsPort) < 0) {
+            std::cerr << "Could not serve metrics on " << parser.value(metricsOption).toStdString() << std::endl;
+            return 1;
+        }
+        std::cout << "Serving metrics on port " << metricsPort << std::endl;
+    }
+
+    for (const auto &peer : parser.values(peerOption)) {
+        QString host;
+        quint16 peerPort;
+        if (!PeerManager::parseAddress(peer, host, peerPort)) {
+            std::cerr << "Invalid peer address " << peer.toStdString() << std::endl;
+            return 1;
+        }
+        blockchain.connectToPeer(host, peerPort);
+    }
+
+    QThread *miner = nullptr;
+    if (!parser.isSet(noMineOption)) {
+        miner = QThread::create([&blockchain]() {
+            blockchain.startMining();
+        });
+        miner->start();
+    }
+    QObject::connect(&a, &QCoreApplication::aboutToQuit, [&blockchain, miner]() {
+        if (!miner)
+            return;
+        blockchain.stopMining();
+        miner->wait();
+        delete miner;
+    });
+
+    return a.exec();
+}
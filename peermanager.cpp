@@ -0,0 +1,130 @@
+#include "peermanager.h"
+
+#include <QDateTime>
+#include <QTimer>
+
+#include <algorithm>
+
+
+PeerManager::PeerManager(QObject *parent)
+    : QObject{parent}
+{
+
+}
+
+
+PeerManager::~PeerManager()
+{
+    // Sockets are deleted with us, nobody should hear about it
+    for (auto peer : peers) {
+        if (peer->socket) {
+            peer->socket->disconnect();
+            peer->socket->abort();
+        }
+    }
+    qDeleteAll(peers);
+}
+
+
+/**
+ * @brief Parses "port", "host:port" or "[ipv6]:port", a missing host is DEFAULT_PEER_HOST.
+ */
+bool PeerManager::parseAddress(const QString &address, QString &host, quint16 &port)
+{
+    auto separator = address.lastIndexOf(':');
+    host = separator < 0 ? QString(DEFAULT_PEER_HOST) : address.left(separator).trimmed();
+    if (host.startsWith('[') && host.endsWith(']'))
+        host = host.mid(1, host.size() - 2);
+    bool ok;
+    auto value = address.mid(separator + 1).trimmed().toUInt(&ok);
+    if (!ok || value == 0 || value > 65535 || host.isEmpty())
+        return false;
+    port = value;
+    return true;
+}
+
+
+/**
+ * @brief Starts following the peer, it is dialed right away and redialed for as long as we run.
+ * @return False if the peer was added before
+ */
+bool PeerManager::addPeer(const QString &host, quint16 port)
+{
+    auto known = std::any_of(peers.cbegin(), peers.cend(), [&host, port](const Peer *peer) {
+        return peer->host == host && peer->port == port;
+    });
+    if (known)
+        return false;
+    auto peer = new Peer;
+    peer->host = host;
+    peer->port = port;
+    peers.append(peer);
+    dial(peer);
+    return true;
+}
+
+
+int PeerManager::peerCount() const
+{
+    return peers.size();
+}
+
+
+int PeerManager::connectedCount() const
+{
+    return std::count_if(peers.cbegin(), peers.cend(), [](const Peer *peer) {
+        return peer->connectedAt > 0;
+    });
+}
+
+
+void PeerManager::dial(Peer *peer)
+{
+    auto socket = new QTcpSocket(this);
+    peer->socket = socket;
+    connect(socket, &QTcpSocket::connected, this, [this, peer, socket]() {
+        peer->connectedAt = QDateTime::currentMSecsSinceEpoch();
+        emit peerConnected(socket);
+    });
+    connect(socket, &QTcpSocket::disconnected, this, [this, peer, socket]() {
+        drop(peer, socket);
+    });
+    connect(socket, &QTcpSocket::errorOccurred, this, [this, peer, socket]() {
+        drop(peer, socket);
+    });
+    QTimer::singleShot(WAIT_TIME, socket, [this, peer, socket]() {
+        if (socket->state() != QAbstractSocket::ConnectedState)
+            drop(peer, socket);
+    });
+    socket->connectToHost(peer->host, peer->port);
+}
+
+
+/**
+ * @brief Closes the connection after an error, a disconnect or a connect
+ * timeout, whichever comes first, and schedules the next attempt.
+ */
+void PeerManager::drop(Peer *peer, QTcpSocket *socket)
+{
+    if (peer->socket != socket)
+        return;
+    peer->socket = nullptr;
+    socket->disconnect(this);
+    auto now = QDateTime::currentMSecsSinceEpoch();
+    auto wasConnected = peer->connectedAt > 0;
+    auto stable = wasConnected && now - peer->connectedAt >= PEER_STABLE_TIME;
+    peer->connectedAt = 0;
+    if (wasConnected)
+        emit peerDisconnected(socket);
+    socket->abort();
+    socket->deleteLater();
+
+    peer->failures = stable ? 0 : peer->failures + 1;
+    auto delay = std::min<qint64>(RECONNECT_MAX_DELAY, qint64(RECONNECT_MIN_DELAY) << std::min(peer->failures, 16));
+    if (!wasConnected)
+        emit peerUnreachable(peer->host, peer->port, delay);
+    QTimer::singleShot(delay, this, [this, peer]() {
+        if (!peer->socket)
+            dial(peer);
+    });
+}
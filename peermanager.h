@@ -0,0 +1,51 @@
+#ifndef PEERMANAGER_H
+#define PEERMANAGER_H
+
+#include <QObject>
+#include <QList>
+#include <QString>
+#include <QTcpSocket>
+
+#include "Constants.h"
+
+/**
+ * @brief Keeps outbound connections to any number of peers. Connecting never
+ * blocks: the result arrives as peerConnected(), and a peer that cannot be
+ * reached or drops the connection is dialed again after an exponential
+ * backoff. A connection that ends before PEER_STABLE_TIME counts as a failure,
+ * so a peer we disconnect for misbehaving is retried later and later.
+ */
+class PeerManager : public QObject
+{
+    Q_OBJECT
+public:
+    explicit PeerManager(QObject *parent = nullptr);
+    virtual ~PeerManager();
+
+    static bool parseAddress(const QString &address, QString &host, quint16 &port);
+    bool addPeer(const QString &host, quint16 port);
+    int peerCount() const;
+    int connectedCount() const;
+
+signals:
+    void peerConnected(QTcpSocket *socket);
+    void peerDisconnected(QTcpSocket *socket);
+    void peerUnreachable(QString host, quint16 port, qint64 retryDelay);
+
+private:
+    struct Peer
+    {
+        QString host;
+        quint16 port {0};
+        QTcpSocket *socket {nullptr};
+        qint64 connectedAt {0};
+        int failures {0};
+    };
+
+    void dial(Peer *peer);
+    void drop(Peer *peer, QTcpSocket *socket);
+
+    QList<Peer *> peers;
+};
+
+#endif // PEERMANAGER_H
@@ -0,0 +1,164 @@
+#include "protocol.h"
+#include "merkletree.h"
+
+#include <QCryptographicHash>
+
+#include <limits>
+
+
+/**
+ * @brief Tip payload: height, hash and cumulative work as a big-endian integer.
+ */
+QByteArray Protocol::encodeTip(const TipInfo &tip)
+{
+    QByteArray payload;
+    Serializer::writeSigned(payload, tip.height);
+    Serializer::writeBytes(payload, tip.hash);
+    Serializer::writeBytes(payload, tip.work.toBytes());
+    return FrameReader::frame(Tip, payload);
+}
+
+
+bool Protocol::decodeTip(const QByteArray &payload, TipInfo &tip)
+{
+    Serializer::Reader reader(payload);
+    QByteArray work;
+    return reader.readSigned(tip.height)
+            && reader.readBytes(tip.hash)
+            && reader.readBytes(work)
+            && reader.atEnd()
+            && ChainWork::fromBytes(work, tip.work);
+}
+
+
+/**
+ * @brief GetBlocks payload: hash count, then the raw 32-byte hashes.
+ */
+QByteArray Protocol::encodeGetBlocks(const QVector<QByteArray> &locator)
+{
+    QByteArray payload;
+    payload.reserve(10 + locator.size() * 32);
+    Serializer::writeVarint(payload, locator.size());
+    for (const auto &hash : locator)
+        payload.append(hash.leftJustified(32, '\0', true));
+    return FrameReader::frame(GetBlocks, payload);
+}
+
+
+bool Protocol::decodeGetBlocks(const QByteArray &payload, QVector<QByteArray> &locator)
+{
+    Serializer::Reader reader(payload);
+    quint64 count;
+    if (!reader.readVarint(count) || count > quint64(payload.size()) / 32)
+        return false;
+    locator.reserve(count);
+    for (quint64 i = 0; i < count; i++) {
+        QByteArray hash;
+        if (!reader.readRaw(hash, 32))
+            return false;
+        locator.push_back(hash);
+    }
+    return reader.atEnd();
+}
+
+
+QByteArray Protocol::encodeBlocks(const QVector<Block> &blocks)
+{
+    return FrameReader::frame(Blocks, Block::serializeBlocks(blocks));
+}
+
+
+bool Protocol::decodeBlocks(const QByteArray &payload, QVector<Block> &blocks)
+{
+    return Block::deserializeBlocks(payload, blocks);
+}
+
+
+QByteArray Protocol::encodeTransactions(const QVector<Transaction> &transactions)
+{
+    return FrameReader::frame(Transactions, Transaction::serializeList(transactions));
+}
+
+
+bool Protocol::decodeTransactions(const QByteArray &payload, QVector<Transaction> &transactions)
+{
+    return Transaction::deserializeList(payload, transactions);
+}
+
+
+/**
+ * @brief GetProof payload: the raw 32-byte block and transaction hashes.
+ */
+QByteArray Protocol::encodeGetProof(const QByteArray &blockHash, const QByteArray &transactionHash)
+{
+    return FrameReader::frame(GetProof, blockHash.leftJustified(32, '\0', true) + transactionHash.leftJustified(32, '\0', true));
+}
+
+
+bool Protocol::decodeGetProof(const QByteArray &payload, QByteArray &blockHash, QByteArray &transactionHash)
+{
+    Serializer::Reader reader(payload);
+    return reader.readRaw(blockHash, 32)
+            && reader.readRaw(transactionHash, 32)
+            && reader.atEnd();
+}
+
+
+/**
+ * @brief Proof payload: header and transaction hash with their lengths,
+ * position, count, then the path length and the raw 32-byte path hashes.
+ */
+QByteArray Protocol::encodeProof(const InclusionProof &proof)
+{
+    QByteArray payload;
+    Serializer::writeBytes(payload, proof.header);
+    Serializer::writeBytes(payload, proof.transaction);
+    Serializer::writeVarint(payload, proof.position);
+    Serializer::writeVarint(payload, proof.count);
+    Serializer::writeVarint(payload, proof.path.size());
+    for (const auto &hash : proof.path)
+        payload.append(hash.leftJustified(32, '\0', true));
+    return FrameReader::frame(Proof, payload);
+}
+
+
+bool Protocol::decodeProof(const QByteArray &payload, InclusionProof &proof)
+{
+    Serializer::Reader reader(payload);
+    quint64 position, count, length;
+    if (!reader.readBytes(proof.header) || !reader.readBytes(proof.transaction)
+            || !reader.readVarint(position) || !reader.readVarint(count) || !reader.readVarint(length))
+        return false;
+    // An empty proof answers a request for an unknown block or transaction
+    if (proof.header.isEmpty())
+        return count == 0 && length == 0 && reader.atEnd();
+    // A path has at most one hash per tree level
+    if (position >= count || count > quint64(std::numeric_limits<qint64>::max()) || length > 64)
+        return false;
+    proof.position = position;
+    proof.count = count;
+    proof.path.clear();
+    for (quint64 i = 0; i < length; i++) {
+        QByteArray hash;
+        if (!reader.readRaw(hash, 32))
+            return false;
+        proof.path.push_back(hash);
+    }
+    return reader.atEnd();
+}
+
+
+/**
+ * @brief Checks that the header hashes to the block hash and commits to a
+ * Merkle root the transaction hash and path lead to. The block hash has to
+ * come from a header chain the caller trusts.
+ */
+bool Protocol::verifyProof(const InclusionProof &proof, const QByteArray &blockHash)
+{
+    if (proof.header.size() != Block::HeaderSize
+            || QCryptographicHash::hash(proof.header, QCryptographicHash::Sha256) != blockHash
+            || qFromBigEndian<qint32>(proof.header.constData()) < Block::MerkleVersion)
+        return false;
+    auto root = MerkleTree::rootFromProof(proof.transaction, proof.position, proof.count, proof.path);
+    return !root.isEmpty() && root == proof.header.mid(Block::HeaderCommitmentOffset, 32);
+}
@@ -0,0 +1,75 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "block.h"
+#include "chainwork.h"
+#include "framereader.h"
+#include "serializer.h"
+#include "transaction.h"
+
+/**
+ * @brief Peer messages. Peers announce their tip, ask for the blocks after a
+ * locator and receive only the blocks they are missing. Messages are sent as
+ * frames (see FrameReader) with binary payloads, the frame type is the
+ * MessageType. Peers on the old protocol send unframed full ledgers, which
+ * arrive as Ledger messages.
+ */
+class Protocol
+{
+public:
+    enum MessageType : quint8 {
+        Invalid = 0,
+        Ledger = FrameReader::LegacyType, // Full ledger, old protocol
+        Tip = 2,                          // Height, hash and cumulative difficulty of the sender's tip
+        GetBlocks = 3,                    // Locator of the requester's chain
+        Blocks = 4,                       // Blocks following the first known locator hash
+        Transactions = 5,                 // Pending transactions being relayed
+        GetProof = 6,                     // Block hash and transaction hash
+        Proof = 7                         // Inclusion proof of the transaction, for light peers
+    };
+
+    struct TipInfo
+    {
+        qint64 height {-1};
+        QByteArray hash;
+        ChainWork work;
+    };
+
+    /**
+     * @brief Proof that a transaction is in a block from MerkleVersion on. A light peer
+     * that knows the block hash checks it with verifyProof() in O(log count),
+     * without the other transactions.
+     */
+    struct InclusionProof
+    {
+        QByteArray header;      // Block::writeHeader() bytes, empty if there is no proof
+        QByteArray transaction; // Transaction hash
+        qint64 position {0};
+        qint64 count {0};       // Transactions in the block
+        QVector<QByteArray> path; // MerkleTree::proof()
+    };
+
+    static QByteArray encodeTip(const TipInfo &tip);
+    static bool decodeTip(const QByteArray &payload, TipInfo &tip);
+
+    static QByteArray encodeGetBlocks(const QVector<QByteArray> &locator);
+    static bool decodeGetBlocks(const QByteArray &payload, QVector<QByteArray> &locator);
+
+    static QByteArray encodeBlocks(const QVector<Block> &blocks);
+    static bool decodeBlocks(const QByteArray &payload, QVector<Block> &blocks);
+
+    static QByteArray encodeTransactions(const QVector<Transaction> &transactions);
+    static bool decodeTransactions(const QByteArray &payload, QVector<Transaction> &transactions);
+
+    static QByteArray encodeGetProof(const QByteArray &blockHash, const QByteArray &transactionHash);
+    static bool decodeGetProof(const QByteArray &payload, QByteArray &blockHash, QByteArray &transactionHash);
+
+    static QByteArray encodeProof(const InclusionProof &proof);
+    static bool decodeProof(const QByteArray &payload, InclusionProof &proof);
+    static bool verifyProof(const InclusionProof &proof, const QByteArray &blockHash);
+};
+
+#endif // PROTOCOL_H
@@ -0,0 +1,92 @@
+#include "serializer.h"
+
+
+void Serializer::writeVarint(QByteArray &out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+
+void Serializer::writeSigned(QByteArray &out, qint64 value)
+{
+    writeVarint(out, (quint64(value) << 1) ^ quint64(value >> 63));
+}
+
+
+/**
+ * @brief Writes a varint length followed by the bytes.
+ */
+void Serializer::writeBytes(QByteArray &out, const QByteArray &bytes)
+{
+    writeVarint(out, bytes.size());
+    out.append(bytes);
+}
+
+
+Serializer::Reader::Reader(const QByteArray &bytes)
+    : pos(bytes.constData())
+    , end(bytes.constData() + bytes.size())
+{
+
+}
+
+
+bool Serializer::Reader::readVarint(quint64 &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64 && pos < end; shift += 7) {
+        auto byte = quint8(*pos++);
+        value |= quint64(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+
+bool Serializer::Reader::readSigned(qint64 &value)
+{
+    quint64 raw;
+    if (!readVarint(raw))
+        return false;
+    value = qint64(raw >> 1) ^ -qint64(raw & 1);
+    return true;
+}
+
+
+bool Serializer::Reader::readByte(quint8 &value)
+{
+    if (pos >= end)
+        return false;
+    value = quint8(*pos++);
+    return true;
+}
+
+
+bool Serializer::Reader::readRaw(QByteArray &value, qsizetype size)
+{
+    if (size < 0 || end - pos < size)
+        return false;
+    value = QByteArray(pos, size);
+    pos += size;
+    return true;
+}
+
+
+bool Serializer::Reader::readBytes(QByteArray &value)
+{
+    quint64 size;
+    if (!readVarint(size) || size > quint64(end - pos))
+        return false;
+    return readRaw(value, qsizetype(size));
+}
+
+
+bool Serializer::Reader::atEnd() const
+{
+    return pos == end;
+}
@@ -0,0 +1,39 @@
+#ifndef SERIALIZER_H
+#define SERIALIZER_H
+
+#include <QByteArray>
+
+/**
+ * @brief Primitives of the binary encodings. Integers are LEB128 varints,
+ * signed ones zigzag-encoded first so small negative values stay short.
+ */
+class Serializer
+{
+public:
+    static void writeVarint(QByteArray &out, quint64 value);
+    static void writeSigned(QByteArray &out, qint64 value);
+    static void writeBytes(QByteArray &out, const QByteArray &bytes);
+
+    /**
+     * @brief Reads from a buffer that must outlive the reader. Every read
+     * returns false instead of reading past the end.
+     */
+    class Reader
+    {
+    public:
+        explicit Reader(const QByteArray &bytes);
+
+        bool readVarint(quint64 &value);
+        bool readSigned(qint64 &value);
+        bool readByte(quint8 &value);
+        bool readRaw(QByteArray &value, qsizetype size);
+        bool readBytes(QByteArray &value);
+        bool atEnd() const;
+
+    private:
+        const char *pos;
+        const char *end;
+    };
+};
+
+#endif // SERIALIZER_H
@@ -0,0 +1,46 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include "qglobal.h"
+
+#include <array>
+
+/**
+ * @brief Bare SHA-256 compression function. Unlike QCryptographicHash it
+ * exposes the intermediate state, so a constant message prefix can be hashed
+ * once and reused (midstate caching).
+ */
+class Sha256
+{
+public:
+    typedef std::array<quint32, 8> State;
+
+    static const State initialState;
+    static const quint32 k[64];
+
+    static void compress(State &state, const uchar *block);
+    static void expand(quint32 *w);
+    static void store(const State &state, uchar *digest);
+    static quint32 load(const uchar *bytes);
+
+    static inline quint32 rotr(quint32 x, int n)
+    {
+        return (x >> n) | (x << (32 - n));
+    }
+
+    static inline void round(State &s, quint32 k, quint32 w)
+    {
+        quint32 t1 = s[7] + (rotr(s[4], 6) ^ rotr(s[4], 11) ^ rotr(s[4], 25)) + ((s[4] & s[5]) ^ (~s[4] & s[6])) + k + w;
+        quint32 t2 = (rotr(s[0], 2) ^ rotr(s[0], 13) ^ rotr(s[0], 22)) + ((s[0] & s[1]) ^ (s[0] & s[2]) ^ (s[1] & s[2]));
+        s[7] = s[6];
+        s[6] = s[5];
+        s[5] = s[4];
+        s[4] = s[3] + t1;
+        s[3] = s[2];
+        s[2] = s[1];
+        s[1] = s[0];
+        s[0] = t1 + t2;
+    }
+};
+
+#endif // SHA256_H
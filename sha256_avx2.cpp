@@ -0,0 +1,31 @@
+#include "sha256lanes.h"
+#include "sha256lanes_impl.h"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2
+{
+    static constexpr int Lanes = 8;
+    __m256i v;
+
+    static Avx2 set1(quint32 x) { return {_mm256_set1_epi32(int(x))}; }
+    static Avx2 load(const quint32 *p) { return {_mm256_load_si256(reinterpret_cast<const __m256i *>(p))}; }
+    static void store(quint32 *p, Avx2 a) { _mm256_storeu_si256(reinterpret_cast<__m256i *>(p), a.v); }
+    static Avx2 add(Avx2 a, Avx2 b) { return {_mm256_add_epi32(a.v, b.v)}; }
+    static Avx2 bxor(Avx2 a, Avx2 b) { return {_mm256_xor_si256(a.v, b.v)}; }
+    static Avx2 band(Avx2 a, Avx2 b) { return {_mm256_and_si256(a.v, b.v)}; }
+    static Avx2 bor(Avx2 a, Avx2 b) { return {_mm256_or_si256(a.v, b.v)}; }
+    static Avx2 bandnot(Avx2 a, Avx2 b) { return {_mm256_andnot_si256(a.v, b.v)}; }
+    template <int N> static Avx2 shr(Avx2 a) { return {_mm256_srli_epi32(a.v, N)}; }
+    template <int N> static Avx2 rotr(Avx2 a) { return {_mm256_or_si256(_mm256_srli_epi32(a.v, N), _mm256_slli_epi32(a.v, 32 - N))}; }
+};
+
+}
+
+
+void sha256LanesAvx2(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states)
+{
+    sha256LanesKernel<Avx2>(midstate, preState, tail, firstNonce, states);
+}
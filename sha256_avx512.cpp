@@ -0,0 +1,31 @@
+#include "sha256lanes.h"
+#include "sha256lanes_impl.h"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx512
+{
+    static constexpr int Lanes = 16;
+    __m512i v;
+
+    static Avx512 set1(quint32 x) { return {_mm512_set1_epi32(int(x))}; }
+    static Avx512 load(const quint32 *p) { return {_mm512_load_si512(p)}; }
+    static void store(quint32 *p, Avx512 a) { _mm512_storeu_si512(p, a.v); }
+    static Avx512 add(Avx512 a, Avx512 b) { return {_mm512_add_epi32(a.v, b.v)}; }
+    static Avx512 bxor(Avx512 a, Avx512 b) { return {_mm512_xor_si512(a.v, b.v)}; }
+    static Avx512 band(Avx512 a, Avx512 b) { return {_mm512_and_si512(a.v, b.v)}; }
+    static Avx512 bor(Avx512 a, Avx512 b) { return {_mm512_or_si512(a.v, b.v)}; }
+    static Avx512 bandnot(Avx512 a, Avx512 b) { return {_mm512_andnot_si512(a.v, b.v)}; }
+    template <int N> static Avx512 shr(Avx512 a) { return {_mm512_srli_epi32(a.v, N)}; }
+    template <int N> static Avx512 rotr(Avx512 a) { return {_mm512_ror_epi32(a.v, N)}; }
+};
+
+}
+
+
+void sha256LanesAvx512(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states)
+{
+    sha256LanesKernel<Avx512>(midstate, preState, tail, firstNonce, states);
+}
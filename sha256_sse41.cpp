@@ -0,0 +1,31 @@
+#include "sha256lanes.h"
+#include "sha256lanes_impl.h"
+
+#include <smmintrin.h>
+
+namespace {
+
+struct Sse41
+{
+    static constexpr int Lanes = 4;
+    __m128i v;
+
+    static Sse41 set1(quint32 x) { return {_mm_set1_epi32(int(x))}; }
+    static Sse41 load(const quint32 *p) { return {_mm_load_si128(reinterpret_cast<const __m128i *>(p))}; }
+    static void store(quint32 *p, Sse41 a) { _mm_storeu_si128(reinterpret_cast<__m128i *>(p), a.v); }
+    static Sse41 add(Sse41 a, Sse41 b) { return {_mm_add_epi32(a.v, b.v)}; }
+    static Sse41 bxor(Sse41 a, Sse41 b) { return {_mm_xor_si128(a.v, b.v)}; }
+    static Sse41 band(Sse41 a, Sse41 b) { return {_mm_and_si128(a.v, b.v)}; }
+    static Sse41 bor(Sse41 a, Sse41 b) { return {_mm_or_si128(a.v, b.v)}; }
+    static Sse41 bandnot(Sse41 a, Sse41 b) { return {_mm_andnot_si128(a.v, b.v)}; }
+    template <int N> static Sse41 shr(Sse41 a) { return {_mm_srli_epi32(a.v, N)}; }
+    template <int N> static Sse41 rotr(Sse41 a) { return {_mm_or_si128(_mm_srli_epi32(a.v, N), _mm_slli_epi32(a.v, 32 - N))}; }
+};
+
+}
+
+
+void sha256LanesSse41(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states)
+{
+    sha256LanesKernel<Sse41>(midstate, preState, tail, firstNonce, states);
+}
@@ -0,0 +1,19 @@
+#ifndef SHA256LANES_H
+#define SHA256LANES_H
+
+#include "qglobal.h"
+
+/**
+ * Multi-lane kernels for the second header block. Each kernel hashes
+ * consecutive nonces starting at firstNonce, one per lane, and writes the
+ * final states word-major: states[word * lanes + lane].
+ */
+typedef void (*Sha256LaneKernel)(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states);
+
+#ifdef SHA256_X86_LANES
+void sha256LanesSse41(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states);
+void sha256LanesAvx2(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states);
+void sha256LanesAvx512(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states);
+#endif
+
+#endif // SHA256LANES_H
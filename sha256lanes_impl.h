@@ -0,0 +1,69 @@
+#ifndef SHA256LANES_IMPL_H
+#define SHA256LANES_IMPL_H
+
+// Only included by the per-instruction-set kernel sources. V is a vector type
+// local to each source, so every instantiation keeps its own compile flags.
+
+#include "sha256.h"
+
+template <typename V>
+inline V sha256LanesSigma0(V x) { return V::bxor(V::bxor(V::template rotr<7>(x), V::template rotr<18>(x)), V::template shr<3>(x)); }
+
+template <typename V>
+inline V sha256LanesSigma1(V x) { return V::bxor(V::bxor(V::template rotr<17>(x), V::template rotr<19>(x)), V::template shr<10>(x)); }
+
+template <typename V>
+inline void sha256LanesRound(V *s, quint32 k, V w)
+{
+    V e = s[4];
+    V a = s[0];
+    V sum1 = V::bxor(V::bxor(V::template rotr<6>(e), V::template rotr<11>(e)), V::template rotr<25>(e));
+    V ch = V::bxor(V::band(e, s[5]), V::bandnot(e, s[6]));
+    V t1 = V::add(V::add(V::add(s[7], sum1), V::add(ch, V::set1(k))), w);
+    V sum0 = V::bxor(V::bxor(V::template rotr<2>(a), V::template rotr<13>(a)), V::template rotr<22>(a));
+    V maj = V::bor(V::band(a, s[1]), V::band(V::bor(a, s[1]), s[2]));
+    V t2 = V::add(sum0, maj);
+    s[7] = s[6];
+    s[6] = s[5];
+    s[5] = e;
+    s[4] = V::add(s[3], t1);
+    s[3] = s[2];
+    s[2] = s[1];
+    s[1] = a;
+    s[0] = V::add(t1, t2);
+}
+
+template <typename V>
+inline void sha256LanesKernel(const quint32 *midstate, const quint32 *preState, const quint32 *tail, qint64 firstNonce, quint32 *states)
+{
+    constexpr int lanes = V::Lanes;
+    alignas(64) quint32 high[lanes];
+    alignas(64) quint32 low[lanes];
+    for (int lane = 0; lane < lanes; lane++) {
+        quint64 nonce = quint64(firstNonce) + lane;
+        high[lane] = nonce >> 32;
+        low[lane] = quint32(nonce);
+    }
+
+    V w[64];
+    for (int i = 0; i < 6; i++)
+        w[i] = V::set1(tail[i]);
+    w[6] = V::load(high);
+    w[7] = V::load(low);
+    w[8] = V::set1(0x80000000);
+    for (int i = 9; i < 15; i++)
+        w[i] = V::set1(0);
+    w[15] = V::set1(96 * 8);
+    for (int i = 16; i < 64; i++)
+        w[i] = V::add(V::add(w[i - 16], sha256LanesSigma0(w[i - 15])), V::add(w[i - 7], sha256LanesSigma1(w[i - 2])));
+
+    V s[8];
+    for (int i = 0; i < 8; i++)
+        s[i] = V::set1(preState[i]);
+    for (int i = 6; i < 64; i++)
+        sha256LanesRound(s, Sha256::k[i], w[i]);
+    for (int i = 0; i < 8; i++)
+        V::store(states + i * lanes, V::add(s[i], V::set1(midstate[i])));
+}
+
+#endif // SHA256LANES_IMPL_H
@@ -0,0 +1,957 @@
+#include "blockchain.h"
+#include "framereader.h"
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QFile>
+#include <QJsonArray>
+#include <QSet>
+#include <QSysInfo>
+#include <QThread>
+
+#include <algorithm>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+static constexpr int SIM_TICK = 1; // ms between scheduler steps
+static constexpr qint64 SIM_CONNECT_TIMEOUT = 30000; // ms
+static constexpr qint64 SIM_CONVERGE_TIMEOUT = 30000; // ms after the load stops
+static constexpr qint64 SIM_RESYNC_INTERVAL = 1000; // ms between tip announcements while converging
+static constexpr int SIM_TRANSACTION_SIZE = 200; // bytes of transaction data
+
+/**
+ * @brief Lossy, delayed connection between two simulated nodes. The dialing
+ * node connects to the link's own port and the link connects on to the other
+ * node. Whole frames are forwarded in both directions after the latency plus
+ * a random jitter, in order. Frames are dropped with the loss probability,
+ * and all of them while the link is cut, so the nodes see an unreliable
+ * network but never a corrupt stream. Each direction draws from its own
+ * seeded generator, so the n-th frame of a direction always meets the same fate.
+ */
+class SimulatedLink
+{
+public:
+    struct Settings
+    {
+        qint64 latency {0}; // ms, one way
+        qint64 jitter {0};  // ms, at most, added uniformly at random
+        double loss {0};    // Probability of dropping a frame
+    };
+
+    struct Stats
+    {
+        quint64 bytes[2] {};        // Sent by the dialing node, by the other one
+        quint64 droppedBytes[2] {};
+        quint64 frames {0};
+        quint64 droppedFrames {0};
+    };
+
+    SimulatedLink(const QElapsedTimer &clock, int from, int to, quint16 targetPort, const Settings &settings, quint64 seed);
+    ~SimulatedLink();
+
+    bool listen();
+    quint16 getPort() const;
+    int getFrom() const;
+    int getTo() const;
+    void setCut(bool cut);
+    const Stats &getStats() const;
+
+private:
+    struct Direction
+    {
+        QTcpSocket *source {nullptr};
+        QTcpSocket *target {nullptr};
+        int side {0};
+        FrameReader reader;
+        std::deque<QPair<qint64, QByteArray>> queue; // Delivery time, frame
+        qint64 lastDelivery {0};
+        QTimer timer;
+    };
+
+    struct Pipe
+    {
+        QTcpSocket *inbound {nullptr};  // From the dialing node
+        QTcpSocket *outbound {nullptr}; // To the other node
+        Direction forward;
+        Direction backward;
+        bool closed {false};
+    };
+
+    void accept();
+    void read(Pipe *pipe, Direction &direction);
+    void deliver(Direction &direction);
+    void close(Pipe *pipe);
+
+private:
+    const QElapsedTimer &clock;
+    int from;
+    int to;
+    quint16 targetPort;
+    Settings settings;
+    bool cut {false};
+    std::mt19937_64 random[2];
+    Stats stats;
+    QTcpServer server;
+    std::vector<std::unique_ptr<Pipe>> pipes;
+};
+
+
+SimulatedLink::SimulatedLink(const QElapsedTimer &clock, int from, int to, quint16 targetPort, const Settings &settings, quint64 seed)
+    : clock(clock)
+    , from(from)
+    , to(to)
+    , targetPort(targetPort)
+    , settings(settings)
+    , random {std::mt19937_64(seed * 2), std::mt19937_64(seed * 2 + 1)}
+{
+    QObject::connect(&server, &QTcpServer::newConnection, [this]() {
+        accept();
+    });
+}
+
+
+SimulatedLink::~SimulatedLink()
+{
+    for (auto &pipe : pipes) {
+        if (pipe->closed)
+            continue;
+        for (auto *socket : {pipe->inbound, pipe->outbound}) {
+            QObject::disconnect(socket, nullptr, nullptr, nullptr);
+            delete socket;
+        }
+    }
+}
+
+
+bool SimulatedLink::listen()
+{
+    return server.listen(QHostAddress::LocalHost, 0);
+}
+
+
+quint16 SimulatedLink::getPort() const
+{
+    return server.serverPort();
+}
+
+
+int SimulatedLink::getFrom() const
+{
+    return from;
+}
+
+
+int SimulatedLink::getTo() const
+{
+    return to;
+}
+
+
+/**
+ * @brief Drops every frame while the link is cut, the connections stay up
+ * like they would behind a failed route.
+ */
+void SimulatedLink::setCut(bool cut)
+{
+    this->cut = cut;
+}
+
+
+const SimulatedLink::Stats &SimulatedLink::getStats() const
+{
+    return stats;
+}
+
+
+void SimulatedLink::accept()
+{
+    while (server.hasPendingConnections()) {
+        auto pipe = std::make_unique<Pipe>();
+        auto *p = pipe.get();
+        p->inbound = server.nextPendingConnection();
+        p->outbound = new QTcpSocket();
+        p->forward.source = p->inbound;
+        p->forward.target = p->outbound;
+        p->backward.source = p->outbound;
+        p->backward.target = p->inbound;
+        p->backward.side = 1;
+        for (auto *direction : {&p->forward, &p->backward}) {
+            direction->timer.setSingleShot(true);
+            direction->timer.setTimerType(Qt::PreciseTimer);
+            QObject::connect(&direction->timer, &QTimer::timeout, [this, direction]() {
+                deliver(*direction);
+            });
+            QObject::connect(direction->source, &QTcpSocket::readyRead, [this, p, direction]() {
+                read(p, *direction);
+            });
+            QObject::connect(direction->source, &QTcpSocket::disconnected, [this, p]() {
+                close(p);
+            });
+        }
+        // Frames from the dialing node wait until the other node accepted
+        QObject::connect(p->outbound, &QTcpSocket::connected, [this, p]() {
+            deliver(p->forward);
+        });
+        QObject::connect(p->outbound, &QTcpSocket::errorOccurred, [this, p]() {
+            close(p);
+        });
+        p->outbound->connectToHost(QHostAddress::LocalHost, targetPort);
+        pipes.push_back(std::move(pipe));
+    }
+}
+
+
+void SimulatedLink::read(Pipe *pipe, Direction &direction)
+{
+    direction.reader.append(direction.source->readAll());
+    auto now = clock.elapsed();
+    auto &random = this->random[direction.side];
+    std::uniform_real_distribution<double> uniform(0, 1);
+    FrameReader::Frame frame;
+    while (direction.reader.next(frame)) {
+        auto bytes = FrameReader::frame(frame.type, frame.payload);
+        stats.bytes[direction.side] += bytes.size();
+        stats.frames++;
+        // Always draw both, so a cut does not shift the sequence of the frames after it
+        auto lost = uniform(random) < settings.loss;
+        auto jitter = qint64(uniform(random) * settings.jitter);
+        if (cut || lost) {
+            stats.droppedBytes[direction.side] += bytes.size();
+            stats.droppedFrames++;
+            continue;
+        }
+        direction.lastDelivery = std::max(now + settings.latency + jitter, direction.lastDelivery);
+        direction.queue.push_back({direction.lastDelivery, bytes});
+    }
+    if (direction.reader.hasError()) {
+        close(pipe);
+        return;
+    }
+    deliver(direction);
+}
+
+
+/**
+ * @brief Writes the frames that are due and waits for the next one.
+ */
+void SimulatedLink::deliver(Direction &direction)
+{
+    if (direction.target->state() != QAbstractSocket::ConnectedState)
+        return;
+    auto now = clock.elapsed();
+    while (!direction.queue.empty() && direction.queue.front().first <= now) {
+        direction.target->write(direction.queue.front().second);
+        direction.queue.pop_front();
+    }
+    if (!direction.queue.empty() && !direction.timer.isActive())
+        direction.timer.start(int(direction.queue.front().first - now));
+}
+
+
+/**
+ * @brief Closes both ends, the dialing node redials and gets a new pipe.
+ */
+void SimulatedLink::close(Pipe *pipe)
+{
+    if (pipe->closed)
+        return;
+    pipe->closed = true;
+    pipe->forward.timer.stop();
+    pipe->backward.timer.stop();
+    for (auto *socket : {pipe->inbound, pipe->outbound}) {
+        QObject::disconnect(socket, nullptr, nullptr, nullptr);
+        socket->abort();
+        socket->deleteLater();
+    }
+    // Not from inside the signal of one of its timers
+    QTimer::singleShot(0, &server, [this]() {
+        pipes.erase(std::remove_if(pipes.begin(), pipes.end(), [](const std::unique_ptr<Pipe> &pipe) {
+            return pipe->closed;
+        }), pipes.end());
+    });
+}
+
+
+/**
+ * @brief Runs a network of in-process nodes connected by simulated links.
+ * Mining is simulated: blocks are found at exponentially distributed times
+ * with the mean block interval, by a node picked in proportion to its
+ * hashrate, and are built at difficulty 0 on that node's tip. Transactions
+ * are submitted to random nodes at the given rate. Every random choice comes
+ * from a generator seeded with the scenario seed; thread and socket
+ * scheduling still vary between runs, so results repeat statistically.
+ */
+class ChainSimulator
+{
+public:
+    struct Config
+    {
+        QString scenario;
+        int nodes {0};
+        QString topology;
+        int degree {0};
+        SimulatedLink::Settings link;
+        qint64 blockInterval {0}; // ms
+        qint64 duration {0};      // ms
+        double transactionRate {0}; // per second
+        int syncBlocks {0};
+        QVector<double> hashrates;
+        quint64 seed {0};
+    };
+
+    explicit ChainSimulator(const Config &config);
+    ~ChainSimulator();
+
+    bool run();
+    QJsonDocument toJson() const;
+
+private:
+    struct Node
+    {
+        std::unique_ptr<Blockchain> chain;
+        quint16 port {0};
+        int links {0};
+        LedgerSnapshot seen;   // Ledger at the previous poll
+        qint64 reorgs {0};
+        qint64 maxReorgDepth {0};
+    };
+
+    struct MinedBlock
+    {
+        QByteArray hash;
+        qint64 height {0};
+        qint64 foundAt {0};
+        int miner {0};
+        QVector<qint64> arrivals; // ms after foundAt, -1 until the node has it on its best chain
+        int reached {0};
+    };
+
+    bool start();
+    bool buildTopology(QVector<QPair<int, int>> &edges);
+    static Block makeBlock(qint64 index, const QByteArray &prevHash, const QByteArray &payload, qint64 nonce);
+    void scheduleLoad();
+    void mineBlock(int node);
+    void submitTransaction();
+    void setPartitioned(bool partitioned);
+    bool runUntil(qint64 deadline, bool load, const std::function<bool()> &done = {});
+    bool converge(qint64 timeout);
+    bool isConverged() const;
+    void poll();
+    static qint64 commonPrefix(const Ledger &a, const Ledger &b);
+    qint64 nextInterval(double mean);
+
+private:
+    Config config;
+    QElapsedTimer clock;
+    std::mt19937_64 random;
+    std::vector<Node> nodes;
+    std::vector<std::unique_ptr<SimulatedLink>> links;
+    QVector<MinedBlock> mined;
+    QVector<qsizetype> pending; // Mined blocks not on every node yet
+    qint64 nextBlockAt {0};
+    qint64 nextTransactionAt {0};
+    qint64 transactionsSubmitted {0};
+    bool converged {false};
+    qint64 convergedAfter {-1}; // ms from the start of the scenario
+    double wallSeconds {0};
+    double cpuSeconds {0};
+};
+
+
+ChainSimulator::ChainSimulator(const Config &config)
+    : config(config)
+    , random(config.seed)
+{
+    clock.start();
+}
+
+
+ChainSimulator::~ChainSimulator()
+{
+    // Links first, their sockets must not outlive the event loop of the nodes
+    links.clear();
+    nodes.clear();
+}
+
+
+bool ChainSimulator::run()
+{
+    if (!start())
+        return false;
+    auto startedAt = clock.elapsed();
+    auto cpuStart = std::clock();
+    if (config.scenario == "sync") {
+        converged = converge(config.duration);
+    } else if (config.scenario == "partition") {
+        // Connected, then split in two halves that mine separately, then healed
+        auto phase = config.duration / 3;
+        scheduleLoad();
+        runUntil(clock.elapsed() + phase, true);
+        setPartitioned(true);
+        runUntil(clock.elapsed() + phase, true);
+        setPartitioned(false);
+        runUntil(clock.elapsed() + config.duration - 2 * phase, true);
+        converged = converge(SIM_CONVERGE_TIMEOUT);
+    } else {
+        scheduleLoad();
+        runUntil(clock.elapsed() + config.duration, true);
+        converged = converge(SIM_CONVERGE_TIMEOUT);
+    }
+    if (converged)
+        convergedAfter = clock.elapsed() - startedAt;
+    wallSeconds = (clock.elapsed() - startedAt) / 1e3;
+    cpuSeconds = double(std::clock() - cpuStart) / CLOCKS_PER_SEC;
+    return true;
+}
+
+
+/**
+ * @brief Starts the nodes on a shared genesis block, links them and waits
+ * until every link is connected.
+ */
+bool ChainSimulator::start()
+{
+    QVector<QPair<int, int>> edges;
+    if (config.nodes < 1 || !buildTopology(edges)) {
+        std::cerr << "Invalid topology " << config.topology.toStdString() << std::endl;
+        return false;
+    }
+    auto genesis = makeBlock(0, QByteArray(), Transaction::serializeList({Transaction(0, "Genesis " + QByteArray::number(config.seed))}), 0);
+    nodes.resize(config.nodes);
+    for (auto &node : nodes) {
+        node.chain = std::make_unique<Blockchain>();
+        auto port = node.chain->startServer();
+        if (port <= 0) {
+            std::cerr << "Could not start a node server" << std::endl;
+            return false;
+        }
+        node.port = quint16(port);
+        node.chain->acceptBlocks({genesis});
+    }
+    if (config.scenario == "sync") {
+        // Only the first node has the chain, the others download it
+        QVector<Block> blocks;
+        blocks.reserve(config.syncBlocks);
+        auto prevHash = genesis.getHash();
+        for (int i = 1; i <= config.syncBlocks; i++) {
+            blocks.push_back(makeBlock(i, prevHash, Transaction::serializeList({Transaction(0, "Block " + QByteArray::number(i))}), i));
+            prevHash = blocks.back().getHash();
+        }
+        nodes.front().chain->acceptBlocks(blocks);
+    }
+    for (const auto &edge : edges) {
+        auto seed = config.seed + quint64(links.size()) + 1;
+        auto link = std::make_unique<SimulatedLink>(clock, edge.first, edge.second, nodes[edge.second].port, config.link, seed);
+        if (!link->listen()) {
+            std::cerr << "Could not open link " << edge.first << " -> " << edge.second << ", raise the open file limit" << std::endl;
+            return false;
+        }
+        nodes[edge.first].chain->connectToPeer(DEFAULT_PEER_HOST, link->getPort());
+        nodes[edge.first].links++;
+        nodes[edge.second].links++;
+        links.push_back(std::move(link));
+    }
+    auto connected = runUntil(clock.elapsed() + SIM_CONNECT_TIMEOUT, false, [this]() {
+        for (const auto &node : nodes) {
+            if (node.chain->peers.size() < node.links)
+                return false;
+        }
+        return true;
+    });
+    if (!connected) {
+        std::cerr << "Could not connect the nodes" << std::endl;
+        return false;
+    }
+    // Nodes announce their tip when it changes, not to new connections
+    for (auto &node : nodes)
+        node.chain->onBroadcastLedger();
+    return true;
+}
+
+
+/**
+ * @brief Edges as (dialing node, listening node) pairs. A random topology is
+ * a random tree, so it is connected, plus random edges until every node has
+ * the degree.
+ */
+bool ChainSimulator::buildTopology(QVector<QPair<int, int>> &edges)
+{
+    const auto n = config.nodes;
+    if (config.topology == "line" || config.topology == "ring") {
+        for (int i = 1; i < n; i++)
+            edges.push_back({i, i - 1});
+        if (config.topology == "ring" && n > 2)
+            edges.push_back({0, n - 1});
+    } else if (config.topology == "star") {
+        for (int i = 1; i < n; i++)
+            edges.push_back({i, 0});
+    } else if (config.topology == "full") {
+        for (int i = 1; i < n; i++) {
+            for (int j = 0; j < i; j++)
+                edges.push_back({i, j});
+        }
+    } else if (config.topology == "random") {
+        QSet<QPair<int, int>> present;
+        QVector<int> degree(n, 0);
+        auto add = [&](int a, int b) {
+            auto edge = qMakePair(std::max(a, b), std::min(a, b));
+            if (a == b || present.contains(edge))
+                return;
+            present.insert(edge);
+            edges.push_back(edge);
+            degree[a]++;
+            degree[b]++;
+        };
+        for (int i = 1; i < n; i++)
+            add(i, std::uniform_int_distribution<int>(0, i - 1)(random));
+        std::uniform_int_distribution<int> any(0, n - 1);
+        for (int i = 0; i < n; i++) {
+            for (int attempt = 0; degree[i] < std::min(config.degree, n - 1) && attempt < 4 * n; attempt++)
+                add(i, any(random));
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+
+Block ChainSimulator::makeBlock(qint64 index, const QByteArray &prevHash, const QByteArray &payload, qint64 nonce)
+{
+    Block block(index, payload, prevHash, 0);
+    block.setTimestamp(QDateTime::currentMSecsSinceEpoch());
+    block.setNonce(nonce);
+    block.setHash(block.calculateHash());
+    return block;
+}
+
+
+/**
+ * @brief Starts the block and transaction schedules from now.
+ */
+void ChainSimulator::scheduleLoad()
+{
+    auto now = clock.elapsed();
+    nextBlockAt = now + nextInterval(config.blockInterval);
+    if (config.transactionRate > 0)
+        nextTransactionAt = now + nextInterval(1000 / config.transactionRate);
+}
+
+
+/**
+ * @brief The node finds a block on its current tip, with what its mempool holds.
+ */
+void ChainSimulator::mineBlock(int node)
+{
+    auto &chain = *nodes[node].chain;
+    auto ledger = chain.getLedger();
+    auto payload = Transaction::serializeList(chain.mempool.assemble(BLOCK_MAX_PAYLOAD));
+    auto block = makeBlock(ledger->back().index + 1, ledger->back().getHash(), payload, mined.size());
+    if (!chain.addBlock(block))
+        return;
+    MinedBlock record;
+    record.hash = block.getHash();
+    record.height = block.getIndex();
+    record.foundAt = clock.elapsed();
+    record.miner = node;
+    record.arrivals = QVector<qint64>(config.nodes, -1);
+    record.arrivals[node] = 0;
+    record.reached = 1;
+    mined.push_back(record);
+    if (record.reached < config.nodes)
+        pending.push_back(mined.size() - 1);
+}
+
+
+void ChainSimulator::submitTransaction()
+{
+    auto node = std::uniform_int_distribution<int>(0, config.nodes - 1)(random);
+    auto fee = std::uniform_int_distribution<int>(0, 99)(random);
+    auto data = QByteArray(SIM_TRANSACTION_SIZE, char(transactionsSubmitted)) + QByteArray::number(transactionsSubmitted);
+    nodes[node].chain->submitTransaction(Transaction(fee, data));
+    transactionsSubmitted++;
+}
+
+
+/**
+ * @brief Cuts the links between the first and the second half of the nodes.
+ */
+void ChainSimulator::setPartitioned(bool partitioned)
+{
+    auto half = config.nodes / 2;
+    for (auto &link : links) {
+        if ((link->getFrom() < half) != (link->getTo() < half))
+            link->setCut(partitioned);
+    }
+}
+
+
+/**
+ * @brief Runs the event loop until the deadline or until done() holds. With
+ * load, blocks are mined and transactions submitted on their schedules.
+ * @return Whether done() held
+ */
+bool ChainSimulator::runUntil(qint64 deadline, bool load, const std::function<bool()> &done)
+{
+    QEventLoop loop;
+    QTimer ticker;
+    ticker.setTimerType(Qt::PreciseTimer);
+    auto finished = false;
+    QObject::connect(&ticker, &QTimer::timeout, [&]() {
+        auto now = clock.elapsed();
+        if (load) {
+            std::discrete_distribution<int> miner(config.hashrates.cbegin(), config.hashrates.cend());
+            while (now >= nextBlockAt) {
+                mineBlock(miner(random));
+                nextBlockAt += nextInterval(config.blockInterval);
+            }
+            while (config.transactionRate > 0 && now >= nextTransactionAt) {
+                submitTransaction();
+                nextTransactionAt += nextInterval(1000 / config.transactionRate);
+            }
+        }
+        poll();
+        finished = done && done();
+        if (finished || now >= deadline)
+            loop.quit();
+    });
+    ticker.start(SIM_TICK);
+    loop.exec();
+    return finished;
+}
+
+
+/**
+ * @brief Waits until every node has the same tip. Tips are announced every
+ * SIM_RESYNC_INTERVAL meanwhile, like the keepalive does, so announcements
+ * lost on the way do not stall it.
+ */
+bool ChainSimulator::converge(qint64 timeout)
+{
+    auto deadline = clock.elapsed() + timeout;
+    while (clock.elapsed() < deadline) {
+        if (runUntil(std::min(deadline, clock.elapsed() + SIM_RESYNC_INTERVAL), false, [this]() { return isConverged(); }))
+            return true;
+        for (auto &node : nodes)
+            node.chain->onBroadcastLedger();
+    }
+    return false;
+}
+
+
+bool ChainSimulator::isConverged() const
+{
+    auto tip = nodes.front().chain->getLedger()->back().getHash();
+    for (const auto &node : nodes) {
+        if (!node.chain->getLedger()->back().isHash(tip))
+            return false;
+    }
+    return true;
+}
+
+
+/**
+ * @brief Records reorgs and block arrivals on the nodes whose ledger changed
+ * since the previous poll. Arrival times are accurate to SIM_TICK.
+ */
+void ChainSimulator::poll()
+{
+    auto now = clock.elapsed();
+    for (int i = 0; i < config.nodes; i++) {
+        auto &node = nodes[i];
+        auto ledger = node.chain->getLedger();
+        if (ledger == node.seen)
+            continue;
+        if (node.seen) {
+            auto depth = node.seen->size() - commonPrefix(*node.seen, *ledger);
+            if (depth > 0) {
+                node.reorgs++;
+                node.maxReorgDepth = std::max(node.maxReorgDepth, depth);
+            }
+        }
+        node.seen = ledger;
+        for (auto index : pending) {
+            auto &block = mined[index];
+            if (block.arrivals[i] < 0 && block.height < ledger->size() && ledger->header(block.height).isHash(block.hash)) {
+                block.arrivals[i] = now - block.foundAt;
+                block.reached++;
+            }
+        }
+    }
+    pending.erase(std::remove_if(pending.begin(), pending.end(), [this](qsizetype index) {
+        return mined[index].reached == config.nodes;
+    }), pending.end());
+}
+
+
+/**
+ * @brief Number of leading blocks both ledgers share, by binary search.
+ */
+qint64 ChainSimulator::commonPrefix(const Ledger &a, const Ledger &b)
+{
+    qint64 low = 0;
+    qint64 high = std::min(a.size(), b.size());
+    while (low < high) {
+        auto middle = low + (high - low + 1) / 2;
+        if (a.header(middle - 1).hash == b.header(middle - 1).hash)
+            low = middle;
+        else
+            high = middle - 1;
+    }
+    return low;
+}
+
+
+/**
+ * @brief Exponentially distributed interval in ms, as between events of a
+ * Poisson process with the given mean.
+ */
+qint64 ChainSimulator::nextInterval(double mean)
+{
+    return qint64(std::exponential_distribution<double>(1 / mean)(random));
+}
+
+
+QJsonDocument ChainSimulator::toJson() const
+{
+    QJsonObject context;
+    context.insert("date", QDateTime::currentDateTime().toString(Qt::ISODate));
+    context.insert("host_name", QSysInfo::machineHostName());
+    context.insert("num_cpus", QThread::idealThreadCount());
+    context.insert("scenario", config.scenario);
+    context.insert("seed", QString::number(config.seed));
+    context.insert("nodes", config.nodes);
+    context.insert("topology", config.topology);
+    context.insert("links", qint64(links.size()));
+    context.insert("latency_ms", config.link.latency);
+    context.insert("jitter_ms", config.link.jitter);
+    context.insert("loss", config.link.loss);
+    context.insert("block_interval_ms", config.blockInterval);
+    context.insert("duration_ms", config.duration);
+    context.insert("transaction_rate", config.transactionRate);
+
+    // Bandwidth as seen by the links, dropped frames count as sent
+    QVector<quint64> sent(config.nodes, 0);
+    QVector<quint64> received(config.nodes, 0);
+    quint64 bytes = 0;
+    quint64 frames = 0;
+    quint64 droppedFrames = 0;
+    for (const auto &link : links) {
+        const auto &stats = link->getStats();
+        sent[link->getFrom()] += stats.bytes[0];
+        sent[link->getTo()] += stats.bytes[1];
+        received[link->getTo()] += stats.bytes[0] - stats.droppedBytes[0];
+        received[link->getFrom()] += stats.bytes[1] - stats.droppedBytes[1];
+        bytes += stats.bytes[0] + stats.bytes[1];
+        frames += stats.frames;
+        droppedFrames += stats.droppedFrames;
+    }
+
+    // Blocks that reached every node: time until the last one had it
+    QVector<qint64> propagation;
+    double arrivalSum = 0;
+    qint64 arrivals = 0;
+    for (const auto &block : mined) {
+        for (int i = 0; i < config.nodes; i++) {
+            if (i != block.miner && block.arrivals[i] >= 0) {
+                arrivalSum += block.arrivals[i];
+                arrivals++;
+            }
+        }
+        if (block.reached == config.nodes)
+            propagation.push_back(*std::max_element(block.arrivals.cbegin(), block.arrivals.cend()));
+    }
+    std::sort(propagation.begin(), propagation.end());
+    auto percentile = [&propagation](double p) -> qint64 {
+        if (propagation.isEmpty())
+            return -1;
+        return propagation[qsizetype(p * (propagation.size() - 1))];
+    };
+
+    // Blocks off the final best chain of the first node are stale
+    auto final = nodes.front().chain->getLedger();
+    qint64 stale = 0;
+    for (const auto &block : mined) {
+        if (block.height >= final->size() || !final->header(block.height).isHash(block.hash))
+            stale++;
+    }
+    qint64 confirmed = 0;
+    for (qint64 height = 1; height < final->size(); height++) {
+        QVector<Transaction> transactions;
+        if (Transaction::deserializeList(final->payload(height), transactions))
+            confirmed += transactions.size();
+    }
+
+    qint64 reorgs = 0;
+    qint64 maxReorgDepth = 0;
+    double busySeconds = 0;
+    double maxBusySeconds = 0;
+    QJsonArray nodeResults;
+    for (int i = 0; i < config.nodes; i++) {
+        const auto &node = nodes[i];
+        reorgs += node.reorgs;
+        maxReorgDepth = std::max(maxReorgDepth, node.maxReorgDepth);
+        // Timed by the node itself, message handling on the event loop and validation on its pool
+        auto networkSeconds = node.chain->networkTime / 1e9;
+        auto busy = networkSeconds + node.chain->validationTime->total();
+        busySeconds += busy;
+        maxBusySeconds = std::max(maxBusySeconds, busy);
+        QJsonObject result;
+        result.insert("index", i);
+        result.insert("hashrate", config.hashrates[i]);
+        result.insert("height", node.chain->getLedger()->size() - 1);
+        result.insert("links", node.links);
+        result.insert("bytes_sent", qint64(sent[i]));
+        result.insert("bytes_received", qint64(received[i]));
+        result.insert("reorgs", node.reorgs);
+        result.insert("max_reorg_depth", node.maxReorgDepth);
+        result.insert("validation_batches", qint64(node.chain->validationTime->observations()));
+        result.insert("validation_seconds", node.chain->validationTime->total());
+        result.insert("network_seconds", networkSeconds);
+        result.insert("busy_seconds", busy);
+        nodeResults.append(result);
+    }
+
+    QJsonObject results;
+    results.insert("converged", converged);
+    results.insert("converged_after_ms", convergedAfter);
+    results.insert("wall_seconds", wallSeconds);
+    results.insert("height", final->size() - 1);
+    results.insert("blocks_mined", qint64(mined.size()));
+    results.insert("blocks_stale", stale);
+    results.insert("fork_rate", mined.isEmpty() ? 0 : double(stale) / mined.size());
+    results.insert("reorgs", reorgs);
+    results.insert("max_reorg_depth", maxReorgDepth);
+    results.insert("propagation_p50_ms", percentile(0.5));
+    results.insert("propagation_p90_ms", percentile(0.9));
+    results.insert("propagation_max_ms", percentile(1));
+    results.insert("arrival_mean_ms", arrivals ? arrivalSum / arrivals : -1);
+    results.insert("frames", qint64(frames));
+    results.insert("frames_dropped", qint64(droppedFrames));
+    results.insert("bytes", qint64(bytes));
+    results.insert("bytes_per_second", wallSeconds > 0 ? bytes / wallSeconds : 0);
+    results.insert("bytes_per_block", mined.isEmpty() ? 0 : double(bytes) / mined.size());
+    results.insert("transactions_submitted", transactionsSubmitted);
+    results.insert("transactions_confirmed", confirmed);
+    // CPU time of the whole process, links included, and the time each node measured for its own work
+    results.insert("cpu_seconds", cpuSeconds);
+    results.insert("busy_seconds_mean", busySeconds / config.nodes);
+    results.insert("busy_seconds_max", maxBusySeconds);
+
+    QJsonObject root;
+    root.insert("context", context);
+    root.insert("results", results);
+    root.insert("nodes", nodeResults);
+    return QJsonDocument(root);
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QCoreApplication::setApplicationName("SimpleBlockchainSimulator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Simulated network of Simple Blockchain nodes");
+    parser.addHelpOption();
+    QCommandLineOption scenarioOption("scenario", "steady, sync, partition or storm.", "name", "steady");
+    QCommandLineOption nodesOption("nodes", "Number of nodes.", "count", "8");
+    QCommandLineOption topologyOption("topology", "line, ring, star, full or random.", "name", "random");
+    QCommandLineOption degreeOption("degree", "Minimum links per node of a random topology.", "count", "3");
+    QCommandLineOption latencyOption("latency", "One-way link latency.", "ms", "50");
+    QCommandLineOption jitterOption("jitter", "Maximum random latency added per frame.", "ms", "10");
+    QCommandLineOption lossOption("loss", "Probability of a frame being dropped.", "probability", "0");
+    QCommandLineOption intervalOption("block-interval", "Mean time between blocks of the whole network.", "ms", "1000");
+    QCommandLineOption hashrateOption("hashrate", "Comma-separated relative hashrates, missing nodes get 1.", "rates");
+    QCommandLineOption durationOption("duration", "Time under load, the sync timeout for sync.", "ms", "30000");
+    QCommandLineOption transactionRateOption("tx-rate", "Transactions submitted per second.", "rate", "0");
+    QCommandLineOption syncBlocksOption("sync-blocks", "Blocks the first node has in the sync scenario.", "count", "2000");
+    QCommandLineOption seedOption("seed", "Seed of every random choice.", "seed", "1");
+    QCommandLineOption outOption("out", "Write the JSON results to a file instead of stdout.", "file");
+    parser.addOptions({scenarioOption, nodesOption, topologyOption, degreeOption, latencyOption, jitterOption, lossOption,
+                       intervalOption, hashrateOption, durationOption, transactionRateOption, syncBlocksOption, seedOption, outOption});
+    parser.process(a);
+
+    auto scenario = parser.value(scenarioOption);
+    QHash<QString, QString> defaults;
+    if (scenario == "storm")
+        defaults = {{"nodes", "50"}, {"topology", "full"}, {"block-interval", "250"}, {"tx-rate", "1000"}};
+    else if (scenario == "sync")
+        defaults = {{"duration", "60000"}};
+    else if (scenario != "steady" && scenario != "partition") {
+        std::cerr << "Unknown scenario " << scenario.toStdString() << std::endl;
+        return 1;
+    }
+    // Scenario defaults, options given on the command line win
+    auto value = [&parser, &defaults](const QCommandLineOption &option) {
+        auto name = option.names().constFirst();
+        return !parser.isSet(option) && defaults.contains(name) ? defaults.value(name) : parser.value(option);
+    };
+
+    ChainSimulator::Config config;
+    config.scenario = scenario;
+    config.nodes = value(nodesOption).toInt();
+    config.topology = value(topologyOption);
+    config.degree = value(degreeOption).toInt();
+    config.link.latency = std::max<qint64>(0, value(latencyOption).toLongLong());
+    config.link.jitter = std::max<qint64>(0, value(jitterOption).toLongLong());
+    config.link.loss = std::clamp(value(lossOption).toDouble(), 0.0, 1.0);
+    config.blockInterval = std::max<qint64>(1, value(intervalOption).toLongLong());
+    config.duration = std::max<qint64>(0, value(durationOption).toLongLong());
+    config.transactionRate = std::max(0.0, value(transactionRateOption).toDouble());
+    config.syncBlocks = std::max(0, value(syncBlocksOption).toInt());
+    config.seed = value(seedOption).toULongLong();
+    config.hashrates = QVector<double>(std::max(0, config.nodes), 1);
+    auto rates = value(hashrateOption).split(',', Qt::SkipEmptyParts);
+    for (qsizetype i = 0; i < rates.size() && i < config.hashrates.size(); i++)
+        config.hashrates[i] = std::max(0.0, rates[i].toDouble());
+    if (std::accumulate(config.hashrates.cbegin(), config.hashrates.cend(), 0.0) <= 0) {
+        std::cerr << "No node has any hashrate" << std::endl;
+        return 1;
+    }
+
+#ifdef Q_OS_UNIX
+    // Every link takes five sockets, a full mesh of 50 nodes needs thousands
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+
+    QJsonDocument json;
+    {
+        ChainSimulator simulator(config);
+        if (!simulator.run())
+            return 1;
+        json = simulator.toJson();
+    }
+    auto results = json.object().value("results").toObject();
+    std::cerr << scenario.toStdString() << ": " << results.value("blocks_mined").toInteger() << " blocks, fork rate "
+              << results.value("fork_rate").toDouble() << ", propagation p90 " << results.value("propagation_p90_ms").toInteger()
+              << " ms, " << qint64(results.value("bytes_per_second").toDouble()) << " bytes/s, "
+              << (results.value("converged").toBool() ? "converged" : "not converged") << std::endl;
+
+    auto bytes = json.toJson();
+    if (!parser.isSet(outOption)) {
+        std::cout << bytes.toStdString();
+        return 0;
+    }
+    QFile file(parser.value(outOption));
+    if (!file.open(QIODevice::WriteOnly))
+        return 1;
+    file.write(bytes);
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include "blocktree.h"
+#include "Constants.h"
+#include "framereader.h"
+#include "headerhasher.h"
+#include "transaction.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QStringList>
+#include <QVector>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <random>
+
+/**
+ * @brief Randomized tests of the node's parsers and kernels. Every test is
+ * seeded, so a failure repeats; run one by name or all without arguments.
+ */
+class BlockchainTests
+{
+public:
+    bool run(const QStringList &names);
+
+private:
+    bool check(bool condition, const QString &message);
+    void testBlockTree();
+    void testFrameReader();
+    void testHeaderHasher();
+    static QByteArray randomBytes(std::mt19937_64 &random, int size);
+    static QByteArray legacyDocument(std::mt19937_64 &random, int depth);
+
+private:
+    int failures {0};
+};
+
+
+bool BlockchainTests::run(const QStringList &names)
+{
+    const std::map<QString, std::function<void()>> tests {
+        {"blocktree", [this]() { testBlockTree(); }},
+        {"framereader", [this]() { testFrameReader(); }},
+        {"headerhasher", [this]() { testHeaderHasher(); }},
+    };
+    for (const auto &test : tests) {
+        if (!names.isEmpty() && !names.contains(test.first))
+            continue;
+        auto before = failures;
+        test.second();
+        std::cerr << (failures == before ? "PASS " : "FAIL ") << test.first.toStdString() << std::endl;
+    }
+    for (const auto &name : names) {
+        if (tests.find(name) == tests.end()) {
+            std::cerr << "Unknown test " << name.toStdString() << std::endl;
+            failures++;
+        }
+    }
+    return failures == 0;
+}
+
+
+/**
+ * @return The condition, a failure is printed and counted
+ */
+bool BlockchainTests::check(bool condition, const QString &message)
+{
+    if (!condition) {
+        std::cerr << "  " << message.toStdString() << std::endl;
+        failures++;
+    }
+    return condition;
+}
+
+
+/**
+ * @brief Two chains from their own genesis blocks, both longer than the prune
+ * depth, inserted the way Blockchain publishes them: the tree switches to
+ * whichever has more work, back and forth, and every block of the chain it
+ * switches to still has its payload.
+ */
+void BlockchainTests::testBlockTree()
+{
+    std::mt19937_64 random(14);
+    auto makeChain = [&random](qint64 length) {
+        QVector<Block> chain;
+        for (qint64 i = 0; i < length; i++) {
+            auto prevHash = i == 0 ? QByteArray() : chain.back().getHash();
+            chain.push_back(Block(i, 1700000000000 + i, randomBytes(random, 64), randomBytes(random, 32), prevHash, 0, 10, Block::HeaderVersion));
+        }
+        return chain;
+    };
+    auto first = makeChain(3 * BLOCK_PRUNE_DEPTH);
+    auto second = makeChain(4 * BLOCK_PRUNE_DEPTH);
+    QHash<QByteArray, QByteArray> payloads;
+    for (const auto &chain : {first, second}) {
+        for (const auto &block : chain)
+            payloads.insert(block.getHash(), block.getData());
+    }
+
+    BlockTree tree(MAX_ORPHAN_BLOCKS);
+    QVector<QByteArray> ledger; // Hashes of the published chain, its payloads are in payloads
+    auto insert = [&](const QVector<Block> &blocks, qint64 from, qint64 to) {
+        for (auto i = from; i < to; i++)
+            check(tree.insert(blocks[i]), QString("block %1 not inserted").arg(i));
+        // Publish like Blockchain::publishBestChain
+        QVector<QByteArray> branch;
+        qsizetype fork = 0;
+        for (auto hash = tree.getBest(); !hash.isEmpty(); ) {
+            auto node = tree.find(hash);
+            if (node->header.index < ledger.size() && ledger[node->header.index] == hash) {
+                fork = node->header.index + 1;
+                break;
+            }
+            check(!node->pruned && node->payload == payloads.value(hash),
+                  QString("block %1 of the new best chain has no payload").arg(node->header.index));
+            branch.push_back(hash);
+            hash = node->header.getPrevHash();
+        }
+        for (auto i = fork; i < ledger.size(); i++)
+            tree.restore(ledger[i], payloads.value(ledger[i]));
+        ledger.resize(fork);
+        for (auto it = branch.crbegin(); it != branch.crend(); ++it)
+            ledger.push_back(*it);
+        tree.prune(ledger.size() - BLOCK_PRUNE_DEPTH, STALE_BRANCH_AGE);
+    };
+
+    insert(first, 0, first.size());
+    check(tree.find(first[0].getHash())->pruned, "deep blocks of the best chain keep their payload");
+    // The second chain arrives in batches and takes over once it has more work
+    for (qint64 from = 0; from < second.size(); from += MAX_BLOCKS_PER_MESSAGE / 4)
+        insert(second, from, std::min<qint64>(from + MAX_BLOCKS_PER_MESSAGE / 4, second.size()));
+    check(tree.getBest() == second.back().getHash(), "the heavier second chain is not the best one");
+    check(ledger.size() == second.size() && ledger.front() == second.front().getHash(), "the ledger did not switch to the second chain");
+    // The first chain grows past it again
+    auto longer = first;
+    longer.append(makeChain(2 * BLOCK_PRUNE_DEPTH).mid(1));
+    for (auto i = first.size(); i < longer.size(); i++) {
+        longer[i].setIndex(i);
+        longer[i].setPrevHash(longer[i - 1].getHash());
+        payloads.insert(longer[i].getHash(), longer[i].getData());
+    }
+    insert(longer, first.size(), longer.size());
+    check(tree.getBest() == longer.back().getHash(), "the first chain did not take over again");
+    check(ledger.size() == longer.size() && ledger.front() == first.front().getHash(), "the ledger did not switch back");
+}
+
+
+/**
+ * @brief Framed and legacy streams appended in segments split at random
+ * boundaries: single bytes, frames split anywhere and several frames
+ * coalesced in one read. The frames must come out as they went in.
+ */
+void BlockchainTests::testFrameReader()
+{
+    std::mt19937_64 random(6);
+    for (int round = 0; round < 500; round++) {
+        auto legacy = round % 4 == 3;
+        QVector<FrameReader::Frame> expected;
+        QByteArray stream;
+        auto count = std::uniform_int_distribution<int>(1, 20)(random);
+        for (int i = 0; i < count; i++) {
+            FrameReader::Frame frame;
+            if (legacy) {
+                frame.type = FrameReader::LegacyType;
+                frame.payload = legacyDocument(random, 0);
+                // Documents after the first may be separated by whitespace
+                if (i > 0)
+                    stream.append(QByteArray(std::uniform_int_distribution<int>(0, 2)(random), '\n'));
+                stream.append(frame.payload);
+            } else {
+                frame.type = quint8(random());
+                // Mostly small frames, empty ones and a few spanning many reads
+                auto size = std::uniform_int_distribution<int>(0, 19)(random) == 0
+                        ? std::uniform_int_distribution<int>(0, 100000)(random)
+                        : std::uniform_int_distribution<int>(0, 64)(random);
+                frame.payload = randomBytes(random, size);
+                stream.append(FrameReader::frame(frame.type, frame.payload));
+            }
+            expected.push_back(frame);
+        }
+
+        FrameReader reader;
+        QVector<FrameReader::Frame> received;
+        auto maxSegment = std::uniform_int_distribution<int>(0, 3)(random) == 0 ? 1 : int(stream.size());
+        for (qsizetype offset = 0; offset < stream.size(); ) {
+            auto size = std::uniform_int_distribution<qsizetype>(1, std::min<qsizetype>(maxSegment, stream.size() - offset))(random);
+            reader.append(stream.mid(offset, size));
+            offset += size;
+            FrameReader::Frame frame;
+            while (reader.next(frame))
+                received.push_back(frame);
+        }
+
+        auto name = QString("round %1 (%2): ").arg(round).arg(legacy ? "legacy" : "framed");
+        check(!reader.hasError(), name + "stream reported as invalid");
+        check(reader.isLegacy() == legacy, name + "wrong stream mode");
+        check(reader.bufferedBytes() == 0, name + "bytes left in the buffer");
+        if (!check(received.size() == expected.size(), name + QString("%1 frames instead of %2").arg(received.size()).arg(expected.size())))
+            continue;
+        for (qsizetype i = 0; i < expected.size(); i++) {
+            check(received[i].type == expected[i].type && received[i].payload == expected[i].payload,
+                  name + QString("frame %1 differs").arg(i));
+        }
+    }
+}
+
+
+/**
+ * @brief Every lane of every kernel the CPU supports against QCryptographicHash,
+ * over random headers and nonce runs that cross the 32-bit boundaries.
+ */
+void BlockchainTests::testHeaderHasher()
+{
+    std::mt19937_64 random(3);
+    const qint64 boundaries[] = {0, 0x7fffffffLL, 0xffffffffLL, 0x1ffffffffLL, 0x7fffffffffffffffLL - HeaderHasher::MaxLanes};
+    for (int round = 0; round < 200; round++) {
+        auto version = std::uniform_int_distribution<qint32>(Block::HeaderVersion, Block::TargetVersion)(random);
+        QByteArray data;
+        if (version >= Block::MerkleVersion) {
+            QVector<Transaction> transactions;
+            auto count = std::uniform_int_distribution<int>(0, 20)(random);
+            for (int i = 0; i < count; i++)
+                transactions.push_back(Transaction(random() % 1000, randomBytes(random, std::uniform_int_distribution<int>(0, 200)(random))));
+            data = Transaction::serializeList(transactions);
+        } else {
+            data = randomBytes(random, std::uniform_int_distribution<int>(0, 300)(random));
+        }
+        Block block(qint64(random() >> 1), qint64(random() >> 1), data, {}, randomBytes(random, 32), 0,
+                    std::uniform_int_distribution<qint32>(1, 255 * 256)(random), version);
+        HeaderHasher hasher(block);
+
+        // A run ending just before, on or just after a boundary, or anywhere
+        qint64 firstNonce;
+        if (round % 4 == 3) {
+            firstNonce = qint64(random() >> 1);
+        } else {
+            auto boundary = boundaries[std::uniform_int_distribution<int>(0, std::size(boundaries) - 1)(random)];
+            firstNonce = std::max<qint64>(0, boundary - std::uniform_int_distribution<int>(0, HeaderHasher::MaxLanes)(random));
+        }
+
+        for (auto backend : {HeaderHasher::Scalar, HeaderHasher::Sse41, HeaderHasher::Avx2, HeaderHasher::Avx512}) {
+            quint32 states[8 * HeaderHasher::MaxLanes];
+            int lanes = 0;
+            if (!hasher.hashLanes(backend, firstNonce, states, lanes))
+                continue;
+            for (int lane = 0; lane < lanes; lane++) {
+                block.setNonce(firstNonce + lane);
+                uchar header[Block::HeaderSize];
+                block.writeHeader(header);
+                auto expected = QCryptographicHash::hash(QByteArray::fromRawData(reinterpret_cast<const char *>(header), Block::HeaderSize),
+                                                         QCryptographicHash::Sha256);
+                Sha256::State state;
+                for (int i = 0; i < 8; i++)
+                    state[i] = states[i * lanes + lane];
+                QByteArray digest(32, '\0');
+                Sha256::store(state, reinterpret_cast<uchar *>(digest.data()));
+                check(digest == expected, QString("round %1: %2 lane %3 nonce %4 differs")
+                      .arg(round).arg(HeaderHasher::getBackendName(backend)).arg(lane).arg(firstNonce + lane));
+            }
+        }
+
+        block.setNonce(firstNonce);
+        QByteArray digest(32, '\0');
+        hasher.hash(firstNonce, reinterpret_cast<uchar *>(digest.data()));
+        check(digest == block.calculateHash(), QString("round %1: hash() differs").arg(round));
+    }
+}
+
+
+QByteArray BlockchainTests::randomBytes(std::mt19937_64 &random, int size)
+{
+    QByteArray bytes(size, Qt::Uninitialized);
+    for (auto &byte : bytes)
+        byte = char(random());
+    return bytes;
+}
+
+
+/**
+ * @brief JSON object with nested objects and strings holding braces, quotes
+ * and escapes, which the reader must not count.
+ */
+QByteArray BlockchainTests::legacyDocument(std::mt19937_64 &random, int depth)
+{
+    static const QByteArray strings[] = {"\"a\"", "\"}\"", "\"{{\"", "\"\\\"}\"", "\"\\\\\"", "\"x\\\\\\\"{\""};
+    QByteArray document = "{";
+    auto fields = std::uniform_int_distribution<int>(0, 4)(random);
+    for (int i = 0; i < fields; i++) {
+        if (i > 0)
+            document += ",";
+        document += "\"k" + QByteArray::number(i) + "\":";
+        auto kind = std::uniform_int_distribution<int>(0, depth < 3 ? 2 : 1)(random);
+        if (kind == 0)
+            document += QByteArray::number(qint64(random() >> 1));
+        else if (kind == 1)
+            document += strings[std::uniform_int_distribution<int>(0, std::size(strings) - 1)(random)];
+        else
+            document += legacyDocument(random, depth + 1);
+    }
+    return document + "}";
+}
+
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    auto names = QCoreApplication::arguments().mid(1);
+    BlockchainTests tests;
+    return tests.run(names) ? 0 : 1;
+}
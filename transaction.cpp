@@ -0,0 +1,114 @@
+#include "transaction.h"
+#include "Constants.h"
+
+#include <QCryptographicHash>
+
+
+Transaction::Transaction(quint64 fee, const QByteArray &data)
+    : fee(fee)
+    , data(data)
+{
+    QByteArray bytes;
+    serialize(bytes);
+    size = bytes.size();
+    hash = QCryptographicHash::hash(bytes, QCryptographicHash::Sha256);
+}
+
+
+quint64 Transaction::getFee() const
+{
+    return fee;
+}
+
+
+const QByteArray &Transaction::getData() const
+{
+    return data;
+}
+
+
+const QByteArray &Transaction::getHash() const
+{
+    return hash;
+}
+
+
+/**
+ * @brief Serialized size in bytes, what the transaction takes in a block.
+ */
+qint64 Transaction::getSize() const
+{
+    return size;
+}
+
+
+double Transaction::getFeeRate() const
+{
+    return size > 0 ? double(fee) / size : 0;
+}
+
+
+/**
+ * @brief Fee as a varint, then the data with its length.
+ */
+void Transaction::serialize(QByteArray &out) const
+{
+    Serializer::writeVarint(out, fee);
+    Serializer::writeBytes(out, data);
+}
+
+
+bool Transaction::deserialize(Serializer::Reader &reader, Transaction &transaction)
+{
+    quint64 fee;
+    QByteArray data;
+    if (!reader.readVarint(fee) || !reader.readBytes(data) || data.size() > MAX_TRANSACTION_SIZE)
+        return false;
+    transaction = Transaction(fee, data);
+    return true;
+}
+
+
+/**
+ * @brief Transaction count as a varint, then the transactions.
+ */
+QByteArray Transaction::serializeList(const QVector<Transaction> &transactions)
+{
+    QByteArray out;
+    qsizetype size = 10;
+    for (const auto &transaction : transactions)
+        size += transaction.getSize();
+    out.reserve(size);
+    Serializer::writeVarint(out, transactions.size());
+    for (const auto &transaction : transactions)
+        transaction.serialize(out);
+    return out;
+}
+
+
+bool Transaction::deserializeList(const QByteArray &bytes, QVector<Transaction> &transactions)
+{
+    Serializer::Reader reader(bytes);
+    quint64 count;
+    // Every transaction takes at least 2 bytes, do not trust larger counts
+    if (!reader.readVarint(count) || count > quint64(bytes.size()) / 2)
+        return false;
+    transactions.reserve(transactions.size() + count);
+    for (quint64 i = 0; i < count; i++) {
+        Transaction transaction;
+        if (!deserialize(reader, transaction))
+            return false;
+        transactions.push_back(std::move(transaction));
+    }
+    return reader.atEnd();
+}
+
+
+QVector<QByteArray> Transaction::getHashes(const QVector<Transaction> &transactions)
+{
+    QVector<QByteArray> hashes;
+    hashes.reserve(transactions.size());
+    for (const auto &transaction : transactions)
+        hashes.push_back(transaction.getHash());
+    return hashes;
+}
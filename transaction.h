@@ -0,0 +1,39 @@
+#ifndef TRANSACTION_H
+#define TRANSACTION_H
+
+#include <QByteArray>
+#include <QVector>
+
+#include "serializer.h"
+
+/**
+ * @brief Opaque workload data carried by blocks. The fee orders pending
+ * transactions in the mempool, the hash of the serialized transaction
+ * identifies it. Block payloads are serialized transaction lists.
+ */
+class Transaction
+{
+public:
+    Transaction() = default;
+    Transaction(quint64 fee, const QByteArray &data);
+
+    quint64 getFee() const;
+    const QByteArray &getData() const;
+    const QByteArray &getHash() const;
+    qint64 getSize() const;
+    double getFeeRate() const;
+
+    void serialize(QByteArray &out) const;
+    static bool deserialize(Serializer::Reader &reader, Transaction &transaction);
+    static QByteArray serializeList(const QVector<Transaction> &transactions);
+    static bool deserializeList(const QByteArray &bytes, QVector<Transaction> &transactions);
+    static QVector<QByteArray> getHashes(const QVector<Transaction> &transactions);
+
+private:
+    quint64 fee {0};
+    QByteArray data;
+    QByteArray hash;
+    qint64 size {0};
+};
+
+#endif // TRANSACTION_H